@@ -5,6 +5,7 @@
  */
 
 #include "MaxV8.h"
+#include "jpatcher_api.h"
 
 namespace cicm
 {
@@ -15,14 +16,23 @@ namespace cicm
     
     Platform* MaxV8::v8_platform;
     
-    class ArrayBufferAllocator : public v8::ArrayBuffer::Allocator {
-    public:
-        virtual void* Allocate(size_t length) {
-            void* data = AllocateUninitialized(length);
-            return data == NULL ? data : memset(data, 0, length);
-        }
-        virtual void* AllocateUninitialized(size_t length) { return malloc(length); }
-        virtual void Free(void* data, size_t) { free(data); }
+    //============================================================================
+    // Background script loading
+    //============================================================================
+    
+    //! A script file being read, parsed and compiled on a worker thread.
+    struct ScriptLoad
+    {
+        MaxV8*              x;
+        long                generation;
+        char                path[MAX_PATH_CHARS];
+        char                filename[MAX_PATH_CHARS];
+        Isolate*            isolate;
+        Persistent<Context> context;
+        Persistent<Script>  script;
+        SourceBuffer*       source;
+        IsolateSettings     settings;
+        string              error;
     };
     
     //============================================================================
@@ -33,20 +43,93 @@ namespace cicm
     {
         // Initialize V8.
         V8::InitializeICU();
+        Profiles::Configure();
         v8_platform = platform::CreateDefaultPlatform();
         V8::InitializePlatform(v8_platform);
         V8::Initialize();
         
+        BufferPool::Init();
+        Channel::Init();
+        Tracer::Init();
+        WasmCache::Init();
+        ExpressionCache::Init();
+        Registry::Init();
+        Watchdog::Start();
+        ThreadPool::Start();
+        
         post("v8 version : %s", V8::GetVersion());
     }
     
     void MaxV8::Release()
     {
+        ThreadPool::Stop();
+        Watchdog::Stop();
+        WasmCache::Release();
+        ExpressionCache::Release();
+        
         V8::Dispose();
         V8::ShutdownPlatform();
         delete v8_platform;
     }
     
+    void MaxV8::RegisterAttributes(t_class* c)
+    {
+        CLASS_ATTR_LONG(c, "timeout", 0, MaxV8, m_timeout);
+        CLASS_ATTR_FILTER_MIN(c, "timeout", 0);
+        CLASS_ATTR_LABEL(c, "timeout", 0, "Time Budget Per Call (ms, 0 = unlimited)");
+        
+        CLASS_ATTR_CHAR(c, "parallel", 0, MaxV8, m_parallel);
+        CLASS_ATTR_STYLE_LABEL(c, "parallel", 0, "onoff", "Run Handlers On Worker Threads");
+        
+        CLASS_ATTR_CHAR(c, "stringmode", 0, MaxV8, m_stringmode);
+        CLASS_ATTR_ENUMINDEX(c, "stringmode", 0, "symbols strings auto");
+        CLASS_ATTR_LABEL(c, "stringmode", 0, "Output JavaScript Strings As");
+        
+        // engine settings are read when the isolate is created, they apply on the next load.
+        CLASS_ATTR_SYM(c, "profile", 0, MaxV8, m_profile);
+        CLASS_ATTR_ENUM(c, "profile", 0, Profiles::Names());
+        CLASS_ATTR_LABEL(c, "profile", 0, "Engine Profile");
+        
+        CLASS_ATTR_LONG(c, "semispace", 0, MaxV8, m_semi_space);
+        CLASS_ATTR_FILTER_MIN(c, "semispace", 0);
+        CLASS_ATTR_LABEL(c, "semispace", 0, "Young Generation Semi-Space (MB, 0 = profile)");
+        
+        CLASS_ATTR_LONG(c, "oldspace", 0, MaxV8, m_old_space);
+        CLASS_ATTR_FILTER_MIN(c, "oldspace", 0);
+        CLASS_ATTR_LABEL(c, "oldspace", 0, "Old Generation Size (MB, 0 = profile)");
+        
+        // console output of post() and error(), batched on the main thread.
+        CLASS_ATTR_CHAR(c, "loglevel", 0, MaxV8, m_log_level);
+        CLASS_ATTR_ENUMINDEX(c, "loglevel", 0, "all errors none");
+        CLASS_ATTR_LABEL(c, "loglevel", 0, "Script Console Output");
+        
+        CLASS_ATTR_LONG(c, "lograte", 0, MaxV8, m_log_rate);
+        CLASS_ATTR_ACCESSORS(c, "lograte", nullptr, SetLogRate);
+        CLASS_ATTR_LABEL(c, "lograte", 0, "Console Lines Per Second (0 = unlimited)");
+        
+        CLASS_ATTR_CHAR(c, "latency", 0, MaxV8, m_latency);
+        CLASS_ATTR_STYLE_LABEL(c, "latency", 0, "onoff", "Measure Message Latency");
+        
+        CLASS_ATTR_CHAR(c, "jitdiag", 0, MaxV8, m_jitdiag);
+        CLASS_ATTR_ACCESSORS(c, "jitdiag", nullptr, SetJitDiag);
+        CLASS_ATTR_STYLE_LABEL(c, "jitdiag", 0, "onoff", "Record JIT Optimizations");
+        
+        // windowed inlet, numbers of the left inlet fill a RingBuffer handed to msg_window.
+        CLASS_ATTR_LONG(c, "window", 0, MaxV8, m_window);
+        CLASS_ATTR_ACCESSORS(c, "window", nullptr, SetWindow);
+        CLASS_ATTR_LABEL(c, "window", 0, "Numbers Kept For msg_window (0 = off)");
+        
+        CLASS_ATTR_LONG(c, "hop", 0, MaxV8, m_hop);
+        CLASS_ATTR_ACCESSORS(c, "hop", nullptr, SetHop);
+        CLASS_ATTR_LABEL(c, "hop", 0, "Numbers Between msg_window Calls (0 = window)");
+        
+        CLASS_ATTR_CHAR(c, "snapshot", 0, MaxV8, m_snapshot);
+        CLASS_ATTR_STYLE_LABEL(c, "snapshot", 0, "onoff", "Save Script State With The Patcher");
+        
+        CLASS_ATTR_SYM(c, "statename", 0, MaxV8, m_state_name);
+        CLASS_ATTR_LABEL(c, "statename", 0, "Global State Object Saved In Snapshots");
+    }
+    
     Local<v8::Context> MaxV8::createMaxContext(v8::Isolate* isolate)
     {
         // Create a template for the global object.
@@ -73,9 +156,31 @@ namespace cicm
         // proxy_getinlet wrapper
         global->SetAccessor(String::NewFromUtf8(isolate, "inlet"), JsProxyInletsGetter, nullptr, obj_ptr, ALL_CAN_READ);
         
-        // Bind the global 'outlet' function to the C++ callback.
-        global->Set(v8::String::NewFromUtf8(isolate, "outlet"),
-                    v8::FunctionTemplate::New(isolate, JsOutput, obj_ptr));
+        // Bind the global 'outlet' function to the C++ callback,
+        // with outlet.emit([[index, values...], ...]) and outlet.bind(index) for bursts.
+        Local<FunctionTemplate> outlet = v8::FunctionTemplate::New(isolate, JsOutput, obj_ptr);
+        outlet->Set(String::NewFromUtf8(isolate, "emit"), FunctionTemplate::New(isolate, JsOutletEmit, obj_ptr));
+        outlet->Set(String::NewFromUtf8(isolate, "bind"), FunctionTemplate::New(isolate, JsOutletBind, obj_ptr));
+        global->Set(v8::String::NewFromUtf8(isolate, "outlet"), outlet);
+        
+        // Bind the global 'Channel' object, Channel.open(name) returns an endpoint of a named channel.
+        Local<ObjectTemplate> channel = ObjectTemplate::New(isolate);
+        channel->Set(String::NewFromUtf8(isolate, "open"), FunctionTemplate::New(isolate, JsChannelOpen, obj_ptr));
+        global->Set(String::NewFromUtf8(isolate, "Channel"), channel);
+        
+        // Bind the global 'readFile' and 'writeFile' functions, they return promises.
+        global->Set(String::NewFromUtf8(isolate, "readFile"), FunctionTemplate::New(isolate, JsReadFile, obj_ptr));
+        global->Set(String::NewFromUtf8(isolate, "writeFile"), FunctionTemplate::New(isolate, JsWriteFile, obj_ptr));
+        
+        // Bind the global 'loadwasm' function, loadwasm(file, imports) instantiates a WebAssembly module.
+        global->Set(String::NewFromUtf8(isolate, "loadwasm"), FunctionTemplate::New(isolate, JsLoadWasm, obj_ptr));
+        
+        // Bind the global 'compile' function, compile(source, names...) returns a cached function,
+        // compile.stats() its cache counters.
+        Local<FunctionTemplate> compile = FunctionTemplate::New(isolate, JsCompile, obj_ptr);
+        compile->Set(String::NewFromUtf8(isolate, "stats"), FunctionTemplate::New(isolate, JsCompileStats, obj_ptr));
+        compile->Set(String::NewFromUtf8(isolate, "clear"), FunctionTemplate::New(isolate, JsCompileClear, obj_ptr));
+        global->Set(String::NewFromUtf8(isolate, "compile"), compile);
         
         // Bind the global 'arrayfromargs' function to the C++ callback.
         global->Set(v8::String::NewFromUtf8(isolate, "arrayfromargs"),
@@ -89,34 +194,55 @@ namespace cicm
         global->Set(v8::String::NewFromUtf8(isolate, "setoutletassist"),
                     v8::FunctionTemplate::New(isolate, JsSetOutletAssist, obj_ptr));
         
-        return v8::Context::New(isolate, NULL, global);
+        Local<Context> context = v8::Context::New(isolate, NULL, global);
+        
+        // Define the 'RingBuffer' constructor.
+        RingBuffer::Install(context);
+        
+        return context;
     }
     
-    Local<Value> MaxV8::compileAndRunScript(Isolate* isolate, Local<v8::String> script)
+    Local<Script> MaxV8::compileScript(Isolate* isolate, Local<v8::String> script)
     {
         EscapableHandleScope handle_scope(isolate);
         
         // We're just about to compile the script; set up an error handler to
         // catch any exceptions the script might throw.
-        v8::TryCatch try_catch;
+        v8::TryCatch try_catch(isolate);
         
         // Compile the script and check for errors
-        Local<Script> compiled_script = Script::Compile(script);
+        ScriptOrigin origin(v8::String::NewFromUtf8(isolate, m_filename));
+        MaybeLocal<Script> compiled_script = Script::Compile(isolate->GetCurrentContext(), script, &origin);
         if (compiled_script.IsEmpty())
         {
             v8::String::Utf8Value error_string(try_catch.Exception());
-            object_error((t_object*)&obj, "Compilation error: %s", *error_string);
+            postError("Compilation error: %s", *error_string);
             // The script failed to compile; bail out.
-            return handle_scope.Escape(Local<Value>());
+            return handle_scope.Escape(Local<Script>());
         }
         
+        return handle_scope.Escape(compiled_script.ToLocalChecked());
+    }
+    
+    Local<Value> MaxV8::runScript(Isolate* isolate, Local<Script> script)
+    {
+        EscapableHandleScope handle_scope(isolate);
+        v8::TryCatch try_catch(isolate);
+        
         // Run the script
-        Local<Value> result = compiled_script->Run();
+        m_watchdog->Arm(isolate, gensym("(top level)"), m_timeout);
+        Local<Value> result = script->Run();
+        if (m_watchdog->Disarm())
+        {
+            reportTimeout(m_watchdog->Handler());
+            return handle_scope.Escape(Local<Value>());
+        }
+        
         if (result.IsEmpty())
         {
             // The TryCatch above is still in effect and will have caught the error.
             v8::String::Utf8Value error_string(try_catch.Exception());
-            object_error((t_object*)&obj, "Script error: %s", *error_string);
+            postError("Script error: %s", *error_string);
             // Running the script failed; bail out.
             return handle_scope.Escape(Local<Value>());
         }
@@ -124,237 +250,1463 @@ namespace cicm
         return handle_scope.Escape(result);
     }
     
-    void MaxV8::CompileAndRun(MaxV8 *x)
+    void MaxV8::reportTimeout(t_symbol* handler)
     {
-        // Create a new Isolate and make it the current one.
-        ArrayBufferAllocator allocator;
-        Isolate::CreateParams create_params;
-        create_params.array_buffer_allocator = &allocator;
-        Isolate* isolate = x->m_isolate = Isolate::New(create_params);
-        
-        v8::Isolate::Scope isolate_scope(isolate);
-        v8::HandleScope handle_scope(isolate);
-        v8::Local<v8::Context> context = x->createMaxContext(isolate);
-        x->m_js_context.Reset(isolate, context);
-        
-        const long last_ins = x->m_number_of_inlets > 0 ? x->m_number_of_inlets : 1;
-        const long last_outs = x->m_number_of_outlets;
-        x->m_number_of_inlets = 1;
-        x->m_number_of_outlets = 1;
+        postError("[%s] %s exceeded its %ld ms time budget and was terminated",
+                  m_filename, handler->s_name, m_timeout);
+    }
+    
+    void MaxV8::postError(const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        va_list copy;
+        va_copy(copy, args);
+        const int length = vsnprintf(nullptr, 0, format, copy);
+        va_end(copy);
+        
+        // errors share the queue of error(), the console keeps them in order.
+        string text(length > 0 ? (size_t)length : 0, '\0');
+        if(length > 0)
+        {
+            vsnprintf(&text[0], (size_t)length + 1, format, args);
+        }
+        va_end(args);
         
-        Local<v8::String> script = v8::String::NewFromUtf8(isolate, *x->m_text);
+        m_console->Append(Console::kError, text);
+    }
+    
+    void MaxV8::GetIsolateSettings(MaxV8 *x, IsolateSettings& settings)
+    {
+        settings.profile = Profiles::Find(x->m_profile);
+        if(!settings.profile)
+        {
+            x->postError("unknown profile %s, using default", x->m_profile->s_name);
+            settings.profile = Profiles::Find(gensym("default"));
+        }
+        settings.semi_space = x->m_semi_space;
+        settings.old_space = x->m_old_space;
+        settings.jitdiag = x->m_jitdiag != 0;
+    }
+    
+    Isolate* MaxV8::NewIsolate(MaxV8 *x, IsolateSettings const& settings)
+    {
+        Isolate::CreateParams create_params;
+        create_params.array_buffer_allocator = x->m_allocator;
+        Profiles::Apply(create_params, settings.profile, settings.semi_space, settings.old_space);
         
-        if (!script.IsEmpty())
+        Isolate* isolate = Isolate::New(create_params);
+        if(settings.jitdiag)
         {
-            // Enter the new context so all the following operations take place within it.
-            v8::Context::Scope context_scope(context);
+            x->m_jit_diagnostics->Attach(isolate);
+        }
+        return isolate;
+    }
+    
+    void MaxV8::RetireIsolate(MaxV8 *x)
+    {
+        if(x->m_isolate)
+        {
+            // wait for a worker still running the previous script.
+            Locker previous_locker(x->m_isolate);
+            Isolate::Scope isolate_scope(x->m_isolate);
             x->m_script_compiled = false;
-            x->compileAndRunScript(isolate, script);
-            x->m_script_compiled = true;
+            x->m_js_context.Reset();
+            CloseChannels(x);
+            x->m_compile_cache->Clear();
+            
+            // a queued parallel task or a file request may still reach the old isolate.
+            x->m_retired_isolates->push_back(x->m_isolate);
+            x->m_isolate = nullptr;
+            qelem_set(x->m_retire_qelem);
+        }
+    }
+    
+    void MaxV8::DisposeRetired(MaxV8 *x)
+    {
+        // tasks and requests started from now on only see the current isolate.
+        if(x->m_tasks || x->m_io_running)
+        {
+            clock_fdelay(x->m_retire_clock, kRetireInterval);
+            return;
         }
         
-        ResizeIO(x, last_ins, x->m_number_of_inlets, last_outs, x->m_number_of_outlets);
+        // a request is queued before it stops counting as running, settle them all:
+        // those of the old scripts are dropped.
+        FinishFileRequests(x);
+        
+        for(vector<Isolate*>::iterator it = x->m_retired_isolates->begin(); it != x->m_retired_isolates->end(); ++it)
+        {
+            (*it)->Dispose();
+        }
+        x->m_retired_isolates->clear();
     }
     
-    //============================================================================
-    // MaxV8 Methods called by Max
-    //============================================================================
-    void* MaxV8::NewInstance(t_symbol* s, long argc, t_atom* argv)
+    void MaxV8::RetryDisposeRetired(MaxV8 *x)
     {
-        MaxV8* x = (MaxV8*)object_alloc(obj_class);
+        qelem_set(x->m_retire_qelem);
+    }
+    
+    void MaxV8::CloseChannels(MaxV8* x)
+    {
+        vector<ChannelEndpoint*> endpoints = x->m_mailbox->Endpoints();
+        for(vector<ChannelEndpoint*>::iterator it = endpoints.begin(); it != endpoints.end(); ++it)
+        {
+            Channel::Close(*it);
+        }
+    }
+    
+    void MaxV8::DeliverLetters(MaxV8* x)
+    {
+        if(!x->m_isolate || x->m_js_context.IsEmpty())
+        {
+            return;
+        }
         
-        if (x)
+        Isolate* isolate = x->m_isolate;
+        Locker locker(isolate);
+        Isolate::Scope isolate_scope(isolate);
+        HandleScope handle_scope(isolate);
+        Local<Context> context = Local<Context>::New(isolate, x->m_js_context);
+        Context::Scope context_scope(context);
+        
+        Letter letter;
+        while(x->m_mailbox->Take(letter))
         {
-            x->m_text = sysmem_newhandle(0);
-            x->m_textsize = 0;
-            x->m_texteditor = nullptr;
+            HandleScope letter_scope(isolate);
+            TryCatch try_catch(isolate);
             
-            x->m_obj_argc = argc;
-            if(argc)
+            Local<Value> value;
+            if(letter.value)
+            {
+                value = Local<Value>::New(isolate, *letter.value);
+                delete letter.value;
+            }
+            else
             {
-                x->m_obj_argv = new t_atom[argc];
-                for(long i = 0; i < argc; i++)
+                const bool opened = letter.parcel->Open(isolate, context, x->m_allocator).ToLocal(&value);
+                letter.parcel->Release();
+                if(!opened)
                 {
-                    switch (atom_gettype(argv+i))
-                    {
-                        case A_LONG:    atom_setlong(x->m_obj_argv+i, atom_getlong(argv+i)); break;
-                        case A_FLOAT:   atom_setfloat(x->m_obj_argv+i, atom_getfloat(argv+i)); break;
-                        case A_SYM:     atom_setsym(x->m_obj_argv+i, atom_getsym(argv+i)); break;
-                        default: break;
-                    }
+                    String::Utf8Value error_string(try_catch.Exception());
+                    x->postError("channel %s: %s", letter.endpoint->name->s_name, ToCString(error_string));
+                    continue;
                 }
             }
             
-            if(argc > 0 && atom_gettype(argv) == A_SYM)
+            Local<Object> endpoint = Local<Object>::New(isolate, letter.endpoint->object);
+            Local<Value> handler;
+            if(!endpoint->Get(context, String::NewFromUtf8(isolate, "onmessage")).ToLocal(&handler) || !handler->IsFunction())
             {
-                t_symbol* textfile = atom_getsym(argv);
-                Read(x, textfile);
+                continue;
+            }
+            
+            Local<Value> argv[1] = {value};
+            x->m_watchdog->Arm(isolate, letter.endpoint->name, x->m_timeout);
+            MaybeLocal<Value> result = Local<Function>::Cast(handler)->Call(context, endpoint, 1, argv);
+            if(x->m_watchdog->Disarm())
+            {
+                x->reportTimeout(x->m_watchdog->Handler());
+            }
+            else if(result.IsEmpty() && try_catch.HasCaught())
+            {
+                String::Utf8Value error_string(try_catch.Exception());
+                x->postError("channel %s: %s", letter.endpoint->name->s_name, ToCString(error_string));
             }
         }
-        
-        return x;
     }
     
-    void MaxV8::FreeInstance(MaxV8* x)
+    void MaxV8::Latency(MaxV8* x, t_symbol *s, long ac, t_atom *av)
     {
-        if (x->m_text)
-            sysmem_freehandle(x->m_text);
+        const bool reset = ac > 0 && atom_getsym(av) == gensym("reset");
         
-        if(x->m_obj_argc)
+        // samples are added under the isolate lock, a worker may be adding some.
+        LatencyStats stats;
+        if(x->m_isolate)
         {
-            delete [] x->m_obj_argv;
+            Locker locker(x->m_isolate);
+            TakeLatency(x, stats, reset);
+        }
+        else
+        {
+            TakeLatency(x, stats, reset);
+        }
+        
+        if(reset)
+        {
+            return;
         }
         
-        x->m_js_context.Reset();
+        if(!x->m_latency)
+        {
+            object_warn((t_object*)x, "latency is not measured, turn the latency attribute on");
+        }
         
-        // need to dispose isolate but crash for now !
-        //x->m_isolate->Dispose();
+        stats.wait.Post((t_object*)x, "queue wait");
+        stats.execution.Post((t_object*)x, "execution");
+        stats.response.Post((t_object*)x, "inlet to outlet");
     }
     
-    void MaxV8::Assist(MaxV8* x, void* b, long io_type, long index, char* s)
+    void MaxV8::TakeLatency(MaxV8* x, LatencyStats& stats, bool reset)
     {
-        if (io_type == ASSIST_INLET)
+        stats = *x->m_latency_stats;
+        if(reset)
         {
-            auto it = x->m_inlet_assist.find(index);
-            if(it != x->m_inlet_assist.end())
+            x->m_latency_stats->wait.Reset();
+            x->m_latency_stats->execution.Reset();
+            x->m_latency_stats->response.Reset();
+        }
+    }
+    
+    void MaxV8::Trace(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    {
+        t_symbol* arg = ac > 0 ? atom_getsym(av) : gensym("");
+        
+        if(arg == gensym("stop"))
+        {
+            if(!Tracer::Running())
             {
-                string text = it->second;
-                sprintf(s, "%s", text.c_str());
+                object_error((t_object*)x, "no trace is being recorded");
             }
             else
             {
-                sprintf(s, "%s: Inlet %ld", x->m_filename, index);
+                size_t dropped = 0;
+                if(!Tracer::Stop(dropped))
+                {
+                    object_error((t_object*)x, "can't write the trace file");
+                }
+                else if(dropped)
+                {
+                    object_warn((t_object*)x, "the trace was full, %lu later events were dropped", (unsigned long)dropped);
+                }
             }
+            return;
         }
-        else
+        
+        if(arg == gensym(""))
         {
-            auto it = x->m_outlet_assist.find(index);
-            if(it != x->m_outlet_assist.end())
+            object_error((t_object*)x, "v8js.trace needs a file name or stop");
+            return;
+        }
+        
+        // relative names are written next to the patcher.
+        char path[MAX_PATH_CHARS];
+        short folder;
+        if(arg->s_name[0] == '/' || !PatcherFolder(x, &folder) || path_toabsolutesystempath(folder, arg->s_name, path))
+        {
+            strncpy_zero(path, arg->s_name, MAX_PATH_CHARS);
+        }
+        
+        Tracer::Start(path);
+        object_post((t_object*)x, "recording the latency trace of every instance to %s", path);
+    }
+    
+    t_max_err MaxV8::SetJitDiag(MaxV8* x, void* attr, long ac, t_atom* av)
+    {
+        if(ac && av)
+        {
+            x->m_jitdiag = atom_getlong(av) != 0;
+            
+            // the running isolate switches right away, the next ones when they are created.
+            if(x->m_isolate)
             {
-                string text = it->second;
-                sprintf(s, "%s", text.c_str());
+                Locker locker(x->m_isolate);
+                Isolate::Scope isolate_scope(x->m_isolate);
+                if(x->m_jitdiag)
+                {
+                    x->m_jit_diagnostics->Attach(x->m_isolate);
+                }
+                else
+                {
+                    JitDiagnostics::Detach(x->m_isolate);
+                }
+            }
+        }
+        return MAX_ERR_NONE;
+    }
+    
+    t_max_err MaxV8::SetLogRate(MaxV8* x, void* attr, long ac, t_atom* av)
+    {
+        if(ac && av)
+        {
+            const t_atom_long rate = atom_getlong(av);
+            x->m_log_rate = rate < 0 ? 0 : (long)rate;
+            x->m_console->SetRate(x->m_log_rate);
+        }
+        return MAX_ERR_NONE;
+    }
+    
+    t_max_err MaxV8::SetWindow(MaxV8* x, void* attr, long ac, t_atom* av)
+    {
+        if(ac && av)
+        {
+            const t_atom_long size = atom_getlong(av);
+            x->m_window = size < 0 ? 0 : size > RingBuffer::kMaxCapacity ? RingBuffer::kMaxCapacity : (long)size;
+            x->m_window_feed->Configure(x->m_window, x->m_hop);
+        }
+        return MAX_ERR_NONE;
+    }
+    
+    t_max_err MaxV8::SetHop(MaxV8* x, void* attr, long ac, t_atom* av)
+    {
+        if(ac && av)
+        {
+            const t_atom_long hop = atom_getlong(av);
+            x->m_hop = hop < 0 ? 0 : (long)hop;
+            x->m_window_feed->Configure(x->m_window, x->m_hop);
+        }
+        return MAX_ERR_NONE;
+    }
+    
+    void MaxV8::JitReport(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    {
+        if(ac > 0 && atom_getsym(av) == gensym("reset"))
+        {
+            x->m_jit_diagnostics->Reset();
+            return;
+        }
+        
+        if(!x->m_jitdiag)
+        {
+            object_warn((t_object*)x, "JIT events are not recorded, turn the jitdiag attribute on");
+        }
+        
+        x->m_jit_diagnostics->Post((t_object*)x, x->m_filename);
+    }
+    
+    void MaxV8::RunFileRequest(FileRequest* request)
+    {
+        MaxV8* x = static_cast<MaxV8*>(request->owner);
+        FileIO::Run(request);
+        x->m_file_completions->Post(request);
+        WorkerDone(x, &x->m_io_running);
+    }
+    
+    void MaxV8::FinishFileRequests(MaxV8* x)
+    {
+        vector<FileRequest*> done;
+        x->m_file_completions->Take(done);
+        
+        for(vector<FileRequest*>::iterator it = done.begin(); it != done.end(); ++it)
+        {
+            FileRequest* request = *it;
+            
+            // the script that asked has been reloaded since.
+            if(request->isolate != x->m_isolate || x->m_js_context.IsEmpty())
+            {
+                DiscardFileRequest(request);
+                continue;
+            }
+            
+            Isolate* isolate = request->isolate;
+            Locker locker(isolate);
+            Isolate::Scope isolate_scope(isolate);
+            HandleScope handle_scope(isolate);
+            Local<Context> context = Local<Context>::New(isolate, x->m_js_context);
+            Context::Scope context_scope(context);
+            Local<Promise::Resolver> resolver = Local<Promise::Resolver>::New(isolate, request->resolver);
+            
+            if(!request->error.empty())
+            {
+                resolver->Reject(context, Exception::Error(String::NewFromUtf8(isolate, request->error.c_str()))).FromMaybe(false);
+            }
+            else if(request->kind == FileRequest::kRead)
+            {
+                // the ArrayBuffer takes the bytes as they were read.
+                Local<ArrayBuffer> buffer = request->data ?
+                ArrayBuffer::New(isolate, request->data, request->length, ArrayBufferCreationMode::kInternalized) :
+                ArrayBuffer::New(isolate, 0);
+                if(request->data)
+                {
+                    x->m_allocator->Adopt(request->length);
+                }
+                resolver->Resolve(context, buffer).FromMaybe(false);
             }
             else
             {
-                sprintf(s, "%s: Outlet %ld", x->m_filename, index);
+                resolver->Resolve(context, Number::New(isolate, (double)request->length)).FromMaybe(false);
+            }
+            
+            request->resolver.Reset();
+            delete request;
+            
+            // no script is running, the then callbacks have to be run here.
+            x->m_watchdog->Arm(isolate, gensym("(promise)"), x->m_timeout);
+            isolate->RunMicrotasks();
+            if(x->m_watchdog->Disarm())
+            {
+                x->reportTimeout(x->m_watchdog->Handler());
             }
         }
     }
     
-    void MaxV8::Read(MaxV8* x, t_symbol *s)
+    void MaxV8::DiscardFileRequest(FileRequest* request)
     {
-        defer((t_object *)x, (method)DoRead, s, 0, NULL);
+        {
+            Locker locker(request->isolate);
+            request->resolver.Reset();
+        }
+        FileIO::Discard(request);
+        delete request;
     }
     
-    void MaxV8::DoRead(MaxV8* x, t_symbol *s, long argc, t_atom *argv)
+    void MaxV8::StartFileRequest(FunctionCallbackInfo<Value> const& args, long kind)
     {
-        if (s == gensym(""))
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        
+        Local<Promise::Resolver> resolver;
+        if(!Promise::Resolver::New(context).ToLocal(&resolver))
         {
-            s = gensym(x->m_filename);
+            return;
         }
+        args.GetReturnValue().Set(resolver->GetPromise());
         
+        if(args.Length() < 1 || !args[0]->IsString())
+        {
+            resolver->Reject(context, Exception::TypeError(String::NewFromUtf8(isolate, "a file name is needed"))).FromMaybe(false);
+            return;
+        }
+        
+        FileRequest* request = new FileRequest();
+        request->kind = (FileRequest::Kind)kind;
+        request->owner = x;
+        request->isolate = isolate;
+        
+        // files are read from the search path like scripts, but only written next to the patcher
+        // or to an absolute path: a relative name must not overwrite a file found elsewhere.
+        String::Utf8Value name(args[0]);
         char filename[MAX_PATH_CHARS];
         short path;
-        t_fourcc type = FOUR_CHAR_CODE('TEXT');
+        t_fourcc type;
+        strncpy_zero(filename, ToCString(name), MAX_PATH_CHARS);
         
-        strncpy_zero(filename, s->s_name, MAX_FILENAME_CHARS);
+        bool resolved;
+        if(kind == FileRequest::kRead)
+        {
+            resolved = !locatefile_extended(filename, &path, &type, nullptr, 0)
+            && !path_toabsolutesystempath(path, filename, request->path);
+        }
+        else if(filename[0] == '/')
+        {
+            strncpy_zero(request->path, filename, MAX_PATH_CHARS);
+            resolved = true;
+        }
+        else
+        {
+            resolved = PatcherFolder(x, &path) && !path_toabsolutesystempath(path, filename, request->path);
+        }
         
-        if(locatefile_extended(filename, &path, &type, &type, 1))
+        if(!resolved)
+        {
+            const string error = (kind == FileRequest::kRead ? string("can't find file ") :
+                                  string("can't write next to an unsaved patcher, file ")) + filename;
+            resolver->Reject(context, Exception::Error(String::NewFromUtf8(isolate, error.c_str()))).FromMaybe(false);
+            delete request;
+            return;
+        }
+        
+        if(kind == FileRequest::kWrite)
+        {
+            // the bytes are copied, the script may change them before they are written.
+            Local<Value> value = args.Length() > 1 ? args[1] : Local<Value>::Cast(String::Empty(isolate));
+            if(value->IsArrayBuffer())
+            {
+                ArrayBuffer::Contents contents = Local<ArrayBuffer>::Cast(value)->GetContents();
+                request->input.assign((char*)contents.Data(), (char*)contents.Data() + contents.ByteLength());
+            }
+            else if(value->IsArrayBufferView())
+            {
+                Local<ArrayBufferView> view = Local<ArrayBufferView>::Cast(value);
+                const char* data = (char*)view->Buffer()->GetContents().Data() + view->ByteOffset();
+                request->input.assign(data, data + view->ByteLength());
+            }
+            else
+            {
+                String::Utf8Value text(value);
+                request->input.assign(ToCString(text), ToCString(text) + (*text ? text.length() : 0));
+            }
+        }
+        
+        request->resolver.Reset(isolate, resolver);
+        
+        ATOMIC_INCREMENT(&x->m_io_running);
+        ThreadPool::Post((ThreadPool::Task)RunFileRequest, request);
+    }
+    
+    bool MaxV8::PatcherFolder(MaxV8* x, short* path)
+    {
+        t_object* patcher = nullptr;
+        if(object_obex_lookup(x, gensym("#P"), &patcher) != MAX_ERR_NONE || !patcher)
+        {
+            return false;
+        }
+        
+        // subpatchers have no file of their own.
+        t_symbol* filepath = jpatcher_get_filepath(jpatcher_get_toppatcher(patcher));
+        char filename[MAX_FILENAME_CHARS];
+        return filepath && filepath != gensym("") && !path_frompathname(filepath->s_name, path, filename);
+    }
+    
+    void MaxV8::JsReadFile(FunctionCallbackInfo<Value> const& args)
+    {
+        StartFileRequest(args, FileRequest::kRead);
+    }
+    
+    void MaxV8::JsWriteFile(FunctionCallbackInfo<Value> const& args)
+    {
+        StartFileRequest(args, FileRequest::kWrite);
+    }
+    
+    void MaxV8::SampleHeap(MaxV8* x, Isolate* isolate)
+    {
+        HeapStatistics heap;
+        isolate->GetHeapStatistics(&heap);
+        Registry::Sampled(&x->m_stats, (int64_t)heap.used_heap_size(), x->m_allocator->LiveBytes());
+    }
+    
+    void MaxV8::Top(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    {
+        if(ac > 0 && atom_gettype(av) == A_SYM && atom_getsym(av) == gensym("reset"))
+        {
+            Registry::Reset();
+            return;
+        }
+        
+        Registry::Top((t_object*)x, ac > 0 ? (long)atom_getlong(av) : 0);
+    }
+    
+    void MaxV8::Memory(MaxV8* x)
+    {
+        const InstanceAllocator* allocator = x->m_allocator;
+        object_post((t_object*)x, "arraybuffers: %lld bytes in %lld buffers, peak %lld bytes, %lld allocations",
+                    (long long)allocator->LiveBytes(), (long long)allocator->LiveBuffers(),
+                    (long long)allocator->PeakBytes(), (long long)allocator->Allocations());
+        object_post((t_object*)x, "arraybuffers: %lld bytes pooled for reuse (all instances)",
+                    (long long)BufferPool::CachedBytes());
+    }
+    
+    void MaxV8::RunTopLevel(MaxV8 *x, Local<Context> context, Local<Script> script)
+    {
+        const long last_ins = x->m_number_of_inlets > 0 ? x->m_number_of_inlets : 1;
+        const long last_outs = x->m_number_of_outlets;
+        x->m_number_of_inlets = 1;
+        x->m_number_of_outlets = 1;
+        
+        if (!script.IsEmpty())
+        {
+            // Enter the new context so all the following operations take place within it.
+            v8::Context::Scope context_scope(context);
+            x->m_script_compiled = false;
+            Local<Value> state = ReadState(x, context);
+            x->runScript(context->GetIsolate(), script);
+            RestoreState(x, context, state);
+        }
+        
+        x->m_script_compiled = true;
+        SampleHeap(x, context->GetIsolate());
+        
+        ResizeIO(x, last_ins, x->m_number_of_inlets, last_outs, x->m_number_of_outlets);
+    }
+    
+    Local<Value> MaxV8::ReadState(MaxV8 *x, Local<Context> context)
+    {
+        Isolate* isolate = context->GetIsolate();
+        EscapableHandleScope handle_scope(isolate);
+        TryCatch try_catch(isolate);
+        
+        Local<Value> state = Undefined(isolate);
+        if(!x->m_saved_state->empty())
+        {
+            string error;
+            if(!Snapshot::Read(isolate, context, *x->m_saved_state, error).ToLocal(&state))
+            {
+                x->postError("can't restore %s: %s", x->m_state_name->s_name, error.c_str());
+                state = Undefined(isolate);
+            }
+            
+            // a snapshot is only restored once, reloads start from scratch.
+            vector<uint8_t>().swap(*x->m_saved_state);
+        }
+        
+        // the top level sees what was restored and can skip its initialisers.
+        context->Global()->DefineOwnProperty(context, String::NewFromUtf8(isolate, "restoredState"), state,
+                                             (PropertyAttribute)(ReadOnly | DontDelete)).FromMaybe(false);
+        return handle_scope.Escape(state);
+    }
+    
+    void MaxV8::RestoreState(MaxV8 *x, Local<Context> context, Local<Value> state)
+    {
+        if(state.IsEmpty() || state->IsUndefined())
+        {
+            return;
+        }
+        
+        Isolate* isolate = context->GetIsolate();
+        HandleScope handle_scope(isolate);
+        TryCatch try_catch(isolate);
+        
+        // a top level that didn't pick up restoredState has set up its defaults, the saved state replaces them.
+        context->Global()->Set(context, String::NewFromUtf8(isolate, x->m_state_name->s_name), state).FromMaybe(false);
+        
+        // an optional restore function can rebuild what depends on the state.
+        Local<Value> handler;
+        if(!context->Global()->Get(context, String::NewFromUtf8(isolate, "restore")).ToLocal(&handler) || !handler->IsFunction())
+        {
+            return;
+        }
+        
+        Local<Value> argv[1] = {state};
+        x->m_watchdog->Arm(isolate, gensym("restore"), x->m_timeout);
+        MaybeLocal<Value> result = Local<Function>::Cast(handler)->Call(context, context->Global(), 1, argv);
+        if(x->m_watchdog->Disarm())
+        {
+            x->reportTimeout(x->m_watchdog->Handler());
+        }
+        else if(result.IsEmpty() && try_catch.HasCaught())
+        {
+            String::Utf8Value error_string(try_catch.Exception());
+            x->postError("restore: %s", ToCString(error_string));
+        }
+    }
+    
+    void MaxV8::SaveState(MaxV8* x, t_dictionary* d)
+    {
+        if(!x->m_snapshot || !d)
+        {
+            return;
+        }
+        
+        string text;
+        
+        // the script has not run yet, keep the snapshot it will be restored from.
+        if(!x->m_saved_state->empty())
+        {
+            Snapshot::Encode(x->m_saved_state->data(), x->m_saved_state->size(), text);
+            dictionary_appendstring(d, gensym("v8js_state"), text.c_str());
+            return;
+        }
+        
+        if(!x->m_isolate || !x->m_script_compiled)
+        {
+            return;
+        }
+        
+        Isolate* isolate = x->m_isolate;
+        Locker locker(isolate);
+        Isolate::Scope isolate_scope(isolate);
+        HandleScope handle_scope(isolate);
+        Local<Context> context = Local<Context>::New(isolate, x->m_js_context);
+        Context::Scope context_scope(context);
+        
+        Local<Value> state;
+        if(!context->Global()->Get(context, String::NewFromUtf8(isolate, x->m_state_name->s_name)).ToLocal(&state) || state->IsUndefined())
+        {
+            return;
+        }
+        
+        string error;
+        if(Snapshot::Write(isolate, context, state, text, error))
+        {
+            dictionary_appendstring(d, gensym("v8js_state"), text.c_str());
+        }
+        else
+        {
+            object_error((t_object*)x, "can't save %s: %s", x->m_state_name->s_name, error.c_str());
+        }
+    }
+    
+    void MaxV8::CompileAndRun(MaxV8 *x)
+    {
+        RetireIsolate(x);
+        
+        // a background load still in flight is superseded by this text.
+        x->m_load_generation++;
+        
+        // Create a new Isolate and make it the current one.
+        IsolateSettings settings;
+        GetIsolateSettings(x, settings);
+        Isolate* isolate = NewIsolate(x, settings);
+        {
+            // isolates are shared with the worker threads, every entry goes through a Locker.
+            Locker locker(isolate);
+            x->m_isolate = isolate;
+            v8::Isolate::Scope isolate_scope(isolate);
+            v8::HandleScope handle_scope(isolate);
+            v8::Local<v8::Context> context = x->createMaxContext(isolate);
+            x->m_js_context.Reset(isolate, context);
+            
+            Local<Script> script;
+            Local<v8::String> source = v8::String::NewFromUtf8(isolate, *x->m_text);
+            if (!source.IsEmpty())
+            {
+                v8::Context::Scope context_scope(context);
+                script = x->compileScript(isolate, source);
+            }
+            
+            RunTopLevel(x, context, script);
+        }
+        
+        ReplayPending(x);
+    }
+    
+    void MaxV8::LoadScript(ScriptLoad* load)
+    {
+        MaxV8* x = load->x;
+        
+        load->source = SourceBuffer::Read(load->path, load->error);
+        
+        if(load->source)
+        {
+            Isolate* isolate = load->isolate = NewIsolate(x, load->settings);
+            Locker locker(isolate);
+            Isolate::Scope isolate_scope(isolate);
+            HandleScope handle_scope(isolate);
+            Local<Context> context = x->createMaxContext(isolate);
+            Context::Scope context_scope(context);
+            load->context.Reset(isolate, context);
+            
+            TryCatch try_catch(isolate);
+            ScriptOrigin origin(v8::String::NewFromUtf8(isolate, load->filename));
+            MaybeLocal<Script> script;
+            
+            // V8 reads ASCII sources in place, others have to be decoded.
+            MaybeLocal<v8::String> source_string;
+            if(load->source->IsAscii())
+            {
+                SourceStringResource* resource = new SourceStringResource(load->source);
+                source_string = v8::String::NewExternalOneByte(isolate, resource);
+                if(source_string.IsEmpty())
+                {
+                    delete resource;
+                }
+            }
+            else
+            {
+                source_string = v8::String::NewFromUtf8(isolate, load->source->Data(),
+                                                        NewStringType::kNormal,
+                                                        (int)load->source->Size());
+            }
+            
+            if(!source_string.IsEmpty())
+            {
+                ScriptCompiler::Source source(source_string.ToLocalChecked(), origin);
+                script = ScriptCompiler::Compile(context, &source);
+            }
+            
+            if(script.IsEmpty())
+            {
+                v8::String::Utf8Value error_string(try_catch.Exception());
+                load->error = try_catch.HasCaught() ? ToCString(error_string) : "script too large";
+            }
+            else
+            {
+                load->script.Reset(isolate, script.ToLocalChecked());
+            }
+        }
+        
+        // hand the result to the main thread, a result not yet picked up is outdated.
+        systhread_mutex_lock(x->m_load_mutex);
+        ScriptLoad* outdated = x->m_finished_load;
+        x->m_finished_load = load;
+        systhread_mutex_unlock(x->m_load_mutex);
+        
+        if(outdated)
+        {
+            DiscardLoad(outdated);
+        }
+        
+        qelem_set(x->m_load_qelem);
+        WorkerDone(x, &x->m_loads_running);
+    }
+    
+    void MaxV8::FinishLoad(MaxV8 *x)
+    {
+        systhread_mutex_lock(x->m_load_mutex);
+        ScriptLoad* load = x->m_finished_load;
+        x->m_finished_load = nullptr;
+        systhread_mutex_unlock(x->m_load_mutex);
+        
+        if(!load)
+        {
+            return;
+        }
+        
+        if(load->generation != x->m_load_generation)
+        {
+            DiscardLoad(load);
+            return;
+        }
+        
+        if(!load->isolate)
+        {
+            object_error((t_object *)x, "can't open file %s: %s", load->filename, load->error.c_str());
+            systhread_mutex_lock(x->m_load_mutex);
+            x->m_pending->Clear();
+            x->m_loading = false;
+            systhread_mutex_unlock(x->m_load_mutex);
+            delete load;
+            return;
+        }
+        
+        // keep the source around for the text editor, it is only copied when the editor opens.
+        SetSource(x, load->source);
+        load->source = nullptr;
+        
+        RetireIsolate(x);
+        
+        {
+            Isolate* isolate = load->isolate;
+            Locker locker(isolate);
+            x->m_isolate = isolate;
+            Isolate::Scope isolate_scope(isolate);
+            HandleScope handle_scope(isolate);
+            Local<Context> context = Local<Context>::New(isolate, load->context);
+            x->m_js_context.Reset(isolate, context);
+            
+            Local<Script> script;
+            if(!load->error.empty())
+            {
+                x->postError("Compilation error: %s", load->error.c_str());
+            }
+            else
+            {
+                script = Local<Script>::New(isolate, load->script);
+            }
+            
+            RunTopLevel(x, context, script);
+            
+            load->script.Reset();
+            load->context.Reset();
+        }
+        
+        delete load;
+        
+        ReplayPending(x);
+    }
+    
+    void MaxV8::DiscardLoad(ScriptLoad* load)
+    {
+        if(load->isolate)
+        {
+            {
+                Locker locker(load->isolate);
+                load->script.Reset();
+                load->context.Reset();
+            }
+            
+            load->isolate->Dispose();
+        }
+        
+        if(load->source)
+        {
+            load->source->Release();
+        }
+        
+        delete load;
+    }
+    
+    void MaxV8::ReplayPending(MaxV8 *x)
+    {
+        Message msg;
+        
+        for(;;)
+        {
+            while(x->m_pending->Pop(msg))
+            {
+                if(x->m_parallel)
+                {
+                    Enqueue(x, msg.selector, msg.index, msg.origin, (long)msg.atoms.size(), msg.atoms.empty() ? NULL : &msg.atoms[0], msg.stamp);
+                }
+                else
+                {
+                    x->m_current_inlet = msg.index;
+                    x->m_inlet_captured = true;
+                    x->m_call_stamp = msg.stamp;
+                    CallJsFunction(x, msg.selector, (long)msg.atoms.size(), msg.atoms.empty() ? NULL : &msg.atoms[0]);
+                    x->m_inlet_captured = false;
+                }
+            }
+            
+            // Dispatch queues under the same lock, nothing can slip in between.
+            systhread_mutex_lock(x->m_load_mutex);
+            if(x->m_pending->Empty())
+            {
+                x->m_loading = false;
+                systhread_mutex_unlock(x->m_load_mutex);
+                break;
+            }
+            systhread_mutex_unlock(x->m_load_mutex);
+        }
+    }
+    
+    //============================================================================
+    // MaxV8 Methods called by Max
+    //============================================================================
+    void* MaxV8::NewInstance(t_symbol* s, long argc, t_atom* argv)
+    {
+        MaxV8* x = (MaxV8*)object_alloc(obj_class);
+        
+        if (x)
+        {
+            x->m_text = sysmem_newhandle(0);
+            x->m_textsize = 0;
+            x->m_texteditor = nullptr;
+            x->m_allocator = new InstanceAllocator();
+            x->m_mailbox = new Mailbox(x, (method)DeliverLetters);
+            x->m_file_completions = new FileCompletions(x, (method)FinishFileRequests);
+            x->m_retired_isolates = new vector<Isolate*>();
+            x->m_retire_qelem = qelem_new(x, (method)DisposeRetired);
+            x->m_retire_clock = clock_new(x, (method)RetryDisposeRetired);
+            x->m_window_feed = new WindowFeed();
+            x->m_compile_cache = new ExpressionCache();
+            x->m_long_args = new vector<Local<Value>>();
+            x->m_console = new Console((t_object*)x);
+            x->m_log_level = kLogAll;
+            x->m_log_rate = kDefaultLogRate;
+            x->m_console->SetRate(x->m_log_rate);
+            x->m_stats.owner = (t_object*)x;
+            x->m_stats.filename = x->m_filename;
+            Registry::Add(&x->m_stats);
+            x->m_timeout = 0;
+            x->m_watchdog = new Watchdog::Entry();
+            Watchdog::Register(x->m_watchdog);
+            
+            x->m_parallel = 0;
+            systhread_mutex_new(&x->m_idle_mutex, 0);
+            systhread_cond_new(&x->m_idle_cond, 0);
+            x->m_inbox = new MessageQueue();
+            for(long i = 0; i < kNumOrigins; i++)
+            {
+                x->m_outbox[i] = new MessageQueue();
+            }
+            x->m_flush_qelem = qelem_new(x, (method)FlushMain);
+            x->m_flush_clock = clock_new(x, (method)FlushScheduler);
+            
+            x->m_profile = gensym("default");
+            x->m_semi_space = 0;
+            x->m_old_space = 0;
+            
+            x->m_stringmode = kStringsAsSymbols;
+            
+            x->m_pending = new MessageQueue();
+            systhread_mutex_new(&x->m_load_mutex, 0);
+            x->m_load_qelem = qelem_new(x, (method)FinishLoad);
+            
+            // trailing @attributes are not part of jsarguments
+            const long jsargc = attr_args_offset((short)argc, argv);
+            
+            x->m_obj_argc = jsargc;
+            if(jsargc)
+            {
+                x->m_obj_argv = new t_atom[jsargc];
+                for(long i = 0; i < jsargc; i++)
+                {
+                    switch (atom_gettype(argv+i))
+                    {
+                        case A_LONG:    atom_setlong(x->m_obj_argv+i, atom_getlong(argv+i)); break;
+                        case A_FLOAT:   atom_setfloat(x->m_obj_argv+i, atom_getfloat(argv+i)); break;
+                        case A_SYM:     atom_setsym(x->m_obj_argv+i, atom_getsym(argv+i)); break;
+                        default: break;
+                    }
+                }
+            }
+            
+            static t_int32_atomic trace_tracks = 0;
+            x->m_latency = 0;
+            x->m_call_stamp = x->m_response_stamp = 0.;
+            x->m_latency_stats = new LatencyStats();
+            x->m_deferred_stamps = new StampQueue();
+            x->m_trace_track = ATOMIC_INCREMENT(&trace_tracks);
+            
+            x->m_jitdiag = 0;
+            x->m_jit_diagnostics = new JitDiagnostics();
+            
+            x->m_snapshot = 0;
+            x->m_state_name = gensym("state");
+            x->m_saved_state = new vector<uint8_t>();
+            
+            attr_args_process(x, (short)argc, argv);
+            
+            // state saved with the patcher, handed to the next top level as restoredState.
+            t_dictionary* d = (t_dictionary*)gensym("#D")->s_thing;
+            const char* saved_state = nullptr;
+            if(d && dictionary_getstring(d, gensym("v8js_state"), &saved_state) == MAX_ERR_NONE && saved_state)
+            {
+                if(!Snapshot::Decode(saved_state, *x->m_saved_state))
+                {
+                    object_error((t_object*)x, "ignoring corrupted state snapshot");
+                    x->m_saved_state->clear();
+                }
+            }
+            
+            if(jsargc > 0 && atom_gettype(argv) == A_SYM)
+            {
+                t_symbol* textfile = atom_getsym(argv);
+                Read(x, textfile);
+            }
+        }
+        
+        return x;
+    }
+    
+    void MaxV8::FreeInstance(MaxV8* x)
+    {
+        // stop accepting parallel work and wait for a running worker to return.
+        ATOMIC_INCREMENT(&x->m_freeing);
+        systhread_mutex_lock(x->m_idle_mutex);
+        while(x->m_tasks || x->m_loads_running || x->m_io_running)
+        {
+            systhread_cond_wait(x->m_idle_cond, x->m_idle_mutex);
+        }
+        systhread_mutex_unlock(x->m_idle_mutex);
+        systhread_cond_free(x->m_idle_cond);
+        systhread_mutex_free(x->m_idle_mutex);
+        
+        // no handler is left to update the counters.
+        Registry::Remove(&x->m_stats);
+        
+        // the retired isolates are disposed below.
+        clock_unset(x->m_retire_clock);
+        freeobject((t_object*)x->m_retire_clock);
+        qelem_free(x->m_retire_qelem);
+        
+        qelem_free(x->m_load_qelem);
+        if(x->m_finished_load)
+        {
+            DiscardLoad(x->m_finished_load);
+        }
+        delete x->m_pending;
+        systhread_mutex_free(x->m_load_mutex);
+        
+        qelem_free(x->m_flush_qelem);
+        clock_unset(x->m_flush_clock);
+        freeobject((t_object*)x->m_flush_clock);
+        delete x->m_inbox;
+        for(long i = 0; i < kNumOrigins; i++)
+        {
+            // calls that were never sent still own their strings.
+            Message msg;
+            while(x->m_outbox[i]->Pop(msg))
+            {
+                FreeStrings((long)msg.atoms.size(), msg.atoms.empty() ? NULL : &msg.atoms[0]);
+            }
+            delete x->m_outbox[i];
+        }
+        
+        if (x->m_text)
+            sysmem_freehandle(x->m_text);
+        
+        SetSource(x, nullptr);
+        
+        if(x->m_obj_argc)
+        {
+            delete [] x->m_obj_argv;
+        }
+        
+        Watchdog::Unregister(x->m_watchdog);
+        delete x->m_watchdog;
+        
+        // file requests finished but not delivered yet.
+        vector<FileRequest*> done;
+        x->m_file_completions->Take(done);
+        for(vector<FileRequest*>::iterator it = done.begin(); it != done.end(); ++it)
+        {
+            DiscardFileRequest(*it);
+        }
+        delete x->m_file_completions;
+        
+        // no worker can enter the isolates anymore, dispose them before their allocator.
+        if(x->m_isolate)
+        {
+            {
+                Locker locker(x->m_isolate);
+                Isolate::Scope isolate_scope(x->m_isolate);
+                x->m_js_context.Reset();
+                CloseChannels(x);
+                x->m_compile_cache->Clear();
+            }
+            x->m_isolate->Dispose();
+        }
+        delete x->m_mailbox;
+        
+        for(vector<Isolate*>::iterator it = x->m_retired_isolates->begin(); it != x->m_retired_isolates->end(); ++it)
+        {
+            (*it)->Dispose();
+        }
+        delete x->m_retired_isolates;
+        
+        delete x->m_allocator;
+        delete x->m_jit_diagnostics;
+        delete x->m_latency_stats;
+        delete x->m_deferred_stamps;
+        delete x->m_window_feed;
+        delete x->m_compile_cache;
+        delete x->m_long_args;
+        delete x->m_saved_state;
+        
+        // the last lines of the script still reach the console.
+        x->m_console->Flush(true);
+        delete x->m_console;
+    }
+    
+    void MaxV8::Assist(MaxV8* x, void* b, long io_type, long index, char* s)
+    {
+        if (io_type == ASSIST_INLET)
+        {
+            auto it = x->m_inlet_assist.find(index);
+            if(it != x->m_inlet_assist.end())
+            {
+                string text = it->second;
+                sprintf(s, "%s", text.c_str());
+            }
+            else
+            {
+                sprintf(s, "%s: Inlet %ld", x->m_filename, index);
+            }
+        }
+        else
+        {
+            auto it = x->m_outlet_assist.find(index);
+            if(it != x->m_outlet_assist.end())
+            {
+                string text = it->second;
+                sprintf(s, "%s", text.c_str());
+            }
+            else
+            {
+                sprintf(s, "%s: Outlet %ld", x->m_filename, index);
+            }
+        }
+    }
+    
+    void MaxV8::Read(MaxV8* x, t_symbol *s)
+    {
+        defer((t_object *)x, (method)DoRead, s, 0, NULL);
+    }
+    
+    void MaxV8::DoRead(MaxV8* x, t_symbol *s, long argc, t_atom *argv)
+    {
+        if (s == gensym(""))
+        {
+            s = gensym(x->m_filename);
+        }
+        
+        char filename[MAX_PATH_CHARS];
+        short path;
+        t_fourcc type = FOUR_CHAR_CODE('TEXT');
+        
+        strncpy_zero(filename, s->s_name, MAX_FILENAME_CHARS);
+        
+        if(locatefile_extended(filename, &path, &type, &type, 1))
+        {
+            object_error((t_object *)x, "can't find file %s", filename);
+            return;
+        }
+        
+        // file found, let's read and compile it in the background
+        
+        strncpy_zero(x->m_filename, filename, MAX_FILENAME_CHARS);
+        x->m_path = path;
+        Tracer::NameTrack(x->m_trace_track, filename);
+        
+        ScriptLoad* load = new ScriptLoad();
+        if(path_toabsolutesystempath(path, filename, load->path))
+        {
+            object_error((t_object *)x, "can't resolve path of file %s", filename);
+            delete load;
+            return;
+        }
+        
+        strncpy_zero(load->filename, filename, MAX_PATH_CHARS);
+        load->x = x;
+        load->isolate = nullptr;
+        load->source = nullptr;
+        load->generation = ++x->m_load_generation;
+        
+        // the worker doesn't read the attributes, they may change while it runs.
+        GetIsolateSettings(x, load->settings);
+        
+        // messages are held back until the script has run.
+        x->m_loading = true;
+        ATOMIC_INCREMENT(&x->m_loads_running);
+        ThreadPool::Post((ThreadPool::Task)LoadScript, load);
+    }
+    
+    void MaxV8::OpenEditor(MaxV8* x)
+    {
+        if (x->m_texteditor)
+        {
+            object_attr_setchar(x->m_texteditor, gensym("visible"), 1);
+        }
+        else
+        {
+            if(x->m_source)
+            {
+                // the text of a loaded script is copied the first time it is edited.
+                const long textsize = (long)x->m_source->Size() + 1;
+                sysmem_resizehandle(x->m_text, textsize);
+                sysmem_copyptr(x->m_source->Data(), *x->m_text, textsize - 1);
+                (*x->m_text)[textsize - 1] = '\0';
+                x->m_textsize = textsize;
+                SetSource(x, nullptr);
+            }
+            
+            x->m_texteditor = (t_object*) object_new(CLASS_NOBOX, gensym("jed"), x, 0);
+            object_method(x->m_texteditor, gensym("settext"), *x->m_text, gensym("utf-8"));
+            object_method(x->m_texteditor, gensym("filename"), x->m_filename, x->m_path);
+            
+            
+            //object_attr_setchar(x->m_texteditor, gensym("scratch"), 1);
+            //object_attr_setsym(x->m_texteditor, gensym("title"), gensym("v8 editor"));
+        }
+    }
+    
+    void MaxV8::SetText(MaxV8* x, const char* text, long size)
+    {
+        // reuse the handle, it only grows when the text does.
+        sysmem_resizehandle(x->m_text, size+1);
+        sysmem_copyptr(text, *x->m_text, size);
+        (*x->m_text)[size] = '\0';
+        x->m_textsize = size+1;
+        SetSource(x, nullptr);
+    }
+    
+    void MaxV8::SetSource(MaxV8* x, SourceBuffer* source)
+    {
+        if(x->m_source)
+        {
+            x->m_source->Release();
+        }
+        
+        x->m_source = source;
+    }
+    
+    void MaxV8::EditorClosed(MaxV8* x, char **text, long size)
+    {
+        SetText(x, *text, size);
+        x->m_texteditor = nullptr;
+    }
+    
+    long MaxV8::EditorSaved(MaxV8* x, char **text, long size)
+    {
+        SetText(x, *text, size);
+        
+        CompileAndRun(x);
+        
+        return 0; // tell editor it can save the text
+    }
+    
+    void MaxV8::Loadbang(MaxV8* x)
+    {
+        Dispatch(x, gensym("loadbang"), 0, NULL);
+    }
+    
+    void MaxV8::Bang(MaxV8* x)
+    {
+        Dispatch(x, gensym("bang"), 0, NULL);
+    }
+    
+    void MaxV8::Anything(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    {
+        Dispatch(x, s, ac, av);
+    }
+    
+    void MaxV8::Int(MaxV8* x, long number)
+    {
+        if(x->m_window && proxy_getinlet((t_object*)x) == 0)
+        {
+            if(x->m_window_feed->Push((double)number))
+            {
+                Dispatch(x, gensym("msg_window"), 0, NULL);
+            }
+            return;
+        }
+        
+        t_atom av;
+        atom_setlong(&av, number);
+        Dispatch(x, gensym("msg_int"), 1, &av);
+    }
+    
+    void MaxV8::Float(MaxV8* x, double number)
+    {
+        if(x->m_window && proxy_getinlet((t_object*)x) == 0)
+        {
+            if(x->m_window_feed->Push(number))
+            {
+                Dispatch(x, gensym("msg_window"), 0, NULL);
+            }
+            return;
+        }
+        
+        t_atom av;
+        atom_setfloat(&av, number);
+        Dispatch(x, gensym("msg_float"), 1, &av);
+    }
+    
+    //============================================================================
+    // Message dispatch (main thread or worker threads)
+    //============================================================================
+    
+    void MaxV8::Dispatch(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    {
+        ATOMIC_INCREMENT(&x->m_stats.dispatched);
+        
+        const long origin = systhread_ismainthread() ? kOriginMain : kOriginScheduler;
+        const double stamp = x->m_latency ? LatencyNow() : 0.;
+        
+        if(x->m_loading)
+        {
+            systhread_mutex_lock(x->m_load_mutex);
+            if(x->m_loading)
+            {
+                x->m_pending->Push(s, proxy_getinlet((t_object*)x), origin, ac, av, stamp);
+                systhread_mutex_unlock(x->m_load_mutex);
+                return;
+            }
+            systhread_mutex_unlock(x->m_load_mutex);
+        }
+        
+        if(!x->m_parallel)
+        {
+            if(stamp == 0.)
+            {
+                defer((t_object *)x, (method)CallJsFunction, s, (short)ac, av);
+            }
+            else if(origin == kOriginMain)
+            {
+                // defer would call it right away as well.
+                x->m_call_stamp = stamp;
+                CallJsFunction(x, s, ac, av);
+            }
+            else
+            {
+                x->m_deferred_stamps->Push(stamp);
+                defer((t_object *)x, (method)CallDeferred, s, (short)ac, av);
+            }
+            return;
+        }
+        
+        Enqueue(x, s, proxy_getinlet((t_object*)x), origin, ac, av, stamp);
+    }
+    
+    void MaxV8::CallDeferred(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    {
+        // deferred calls run in order, so do their stamps.
+        x->m_call_stamp = x->m_deferred_stamps->Pop();
+        CallJsFunction(x, s, ac, av);
+    }
+    
+    void MaxV8::Enqueue(MaxV8* x, t_symbol *s, long inlet, long origin, long ac, t_atom *av, double stamp)
+    {
+        if(x->m_freeing)
         {
-            object_error((t_object *)x, "can't find file %s", filename);
             return;
         }
         
-        // file found, let's read it
-        
-        strncpy_zero(x->m_filename, filename, MAX_FILENAME_CHARS);
-        x->m_path = path;
-        
-        t_filehandle fh;
-        short err = path_opensysfile(x->m_filename, path, &fh, PATH_READ_PERM);
+        x->m_inbox->Push(s, inlet, origin, ac, av, stamp);
         
-        if (!err)
+        // a single task per instance keeps its messages in order.
+        if(ATOMIC_COMPARE_SWAP32(0, 1, &x->m_scheduled))
         {
-            sysfile_readtextfile(fh, x->m_text, 0, (t_sysfile_text_flags) (TEXT_LB_NATIVE | TEXT_NULL_TERMINATE));
-            sysfile_close(fh);
-            x->m_textsize = sysmem_handlesize(x->m_text);
-            
-            // compile and run current text script :
-            
-            CompileAndRun(x);
+            PostParallel(x);
         }
     }
     
-    void MaxV8::OpenEditor(MaxV8* x)
+    void MaxV8::PostParallel(MaxV8* x)
     {
-        if (x->m_texteditor)
+        ATOMIC_INCREMENT(&x->m_tasks);
+        ThreadPool::Post((ThreadPool::Task)RunParallel, x);
+    }
+    
+    void MaxV8::RunParallel(MaxV8* x)
+    {
+        Isolate* isolate = x->m_isolate;
+        if(isolate)
         {
-            object_attr_setchar(x->m_texteditor, gensym("visible"), 1);
+            // hold the isolate for the whole batch rather than once per message.
+            Locker locker(isolate);
+            Isolate::Scope isolate_scope(isolate);
+            DrainInbox(x);
         }
         else
         {
-            x->m_texteditor = (t_object*) object_new(CLASS_NOBOX, gensym("jed"), x, 0);
-            object_method(x->m_texteditor, gensym("settext"), *x->m_text, gensym("utf-8"));
-            object_method(x->m_texteditor, gensym("filename"), x->m_filename, x->m_path);
-            
-            
-            //object_attr_setchar(x->m_texteditor, gensym("scratch"), 1);
-            //object_attr_setsym(x->m_texteditor, gensym("title"), gensym("v8 editor"));
+            DrainInbox(x);
         }
-    }
-    
-    void MaxV8::EditorClosed(MaxV8* x, char **text, long size)
-    {
-        if (x->m_text)
-            sysmem_freehandle(x->m_text);
-        
-        x->m_text = sysmem_newhandleclear(size+1);
-        sysmem_copyptr((char *)*text, *x->m_text, size);
-        x->m_textsize = size+1;
-        x->m_texteditor = nullptr;
-    }
-    
-    long MaxV8::EditorSaved(MaxV8* x, char **text, long size)
-    {
-        if (x->m_text)
-            sysmem_freehandle(x->m_text);
         
-        x->m_text = sysmem_newhandleclear(size+1);
-        sysmem_copyptr((char *)*text, *x->m_text, size);
-        x->m_textsize = size+1;
+        for(long origin = 0; origin < kNumOrigins; origin++)
+        {
+            if(!x->m_outbox[origin]->Empty() && ATOMIC_COMPARE_SWAP32(0, 1, &x->m_flush_pending[origin]))
+            {
+                if(origin == kOriginMain)
+                {
+                    qelem_set(x->m_flush_qelem);
+                }
+                else
+                {
+                    clock_fdelay(x->m_flush_clock, 0.);
+                }
+            }
+        }
         
-        CompileAndRun(x);
+        // messages pushed while we were finishing need a new task.
+        x->m_scheduled = 0;
+        if(!x->m_freeing && !x->m_inbox->Empty() && ATOMIC_COMPARE_SWAP32(0, 1, &x->m_scheduled))
+        {
+            PostParallel(x);
+        }
         
-        return 0; // tell editor it can save the text
+        WorkerDone(x, &x->m_tasks);
     }
     
-    void MaxV8::Loadbang(MaxV8* x)
+    void MaxV8::WorkerDone(MaxV8* x, t_int32_atomic* counter)
     {
-        defer((t_object *)x, (method)CallJsFunction, gensym("loadbang"), 0, NULL);
+        // FreeInstance checks the counters under the same lock, it can't miss the wakeup
+        // nor free the instance before the lock is released.
+        systhread_mutex_lock(x->m_idle_mutex);
+        ATOMIC_DECREMENT(counter);
+        systhread_cond_signal(x->m_idle_cond);
+        systhread_mutex_unlock(x->m_idle_mutex);
     }
     
-    void MaxV8::Bang(MaxV8* x)
+    void MaxV8::DrainInbox(MaxV8* x)
     {
-        defer((t_object *)x, (method)CallJsFunction, gensym("bang"), 0, NULL);
+        Message msg;
+        x->m_in_worker = x->m_inlet_captured = true;
+        
+        while(!x->m_freeing && x->m_inbox->Pop(msg))
+        {
+            x->m_current_inlet = msg.index;
+            x->m_current_origin = msg.origin;
+            x->m_call_stamp = msg.stamp;
+            CallJsFunction(x, msg.selector, (long)msg.atoms.size(), msg.atoms.empty() ? NULL : &msg.atoms[0]);
+        }
+        
+        x->m_in_worker = x->m_inlet_captured = false;
     }
     
-    void MaxV8::Anything(MaxV8* x, t_symbol *s, long ac, t_atom *av)
+    void MaxV8::FlushMain(MaxV8* x)
     {
-        defer((t_object *)x, (method)CallJsFunction, s, ac, av);
+        FlushOutbox(x, kOriginMain);
     }
     
-    void MaxV8::Int(MaxV8* x, long number)
+    void MaxV8::FlushScheduler(MaxV8* x)
     {
-        t_atom av;
-        atom_setlong(&av, number);
-        defer((t_object *)x, (method)CallJsFunction, gensym("msg_int"), 1, &av);
+        FlushOutbox(x, kOriginScheduler);
     }
     
-    void MaxV8::Float(MaxV8* x, double number)
+    void MaxV8::FlushOutbox(MaxV8* x, long origin)
     {
-        t_atom av;
-        atom_setfloat(&av, number);
-        defer((t_object *)x, (method)CallJsFunction, gensym("msg_float"), 1, &av);
+        // clear the flag first so a worker queuing more output schedules another flush.
+        x->m_flush_pending[origin] = 0;
+        
+        Message msg;
+        while(x->m_outbox[origin]->Pop(msg))
+        {
+            Emit(x, msg.index, (long)msg.atoms.size(), msg.atoms.empty() ? NULL : &msg.atoms[0]);
+        }
     }
     
     void MaxV8::ResizeIO(MaxV8 *x, long last_ins, long new_ins, long last_outs, long new_outs)
@@ -407,14 +1759,42 @@ namespace cicm
     
     Local<Value> MaxV8::CallJsFunction(MaxV8* x, t_symbol *s, long ac, t_atom *av)
     {
+        const double dispatched = x->m_call_stamp;
+        x->m_call_stamp = 0.;
+        ATOMIC_INCREMENT(&x->m_stats.started);
+        
+        // numbers arriving from now on may dispatch the next window.
+        const bool window_call = ac == 0 && x->m_window && s == gensym("msg_window");
+        if(window_call)
+        {
+            x->m_window_feed->Rearm();
+        }
+        
         if (!x->m_script_compiled)
         {
             return Local<Value>();
         }
         
         Isolate* isolate = x->m_isolate;
+        Locker locker(isolate);
+        Isolate::Scope isolate_scope(isolate);
         HandleScope handle_scope(isolate);
         Local<v8::Context> context = Local<v8::Context>::New(isolate, x->m_js_context);
+        
+        // the window takes the numbers received since the previous call, a call
+        // finding none (the window size changed meanwhile) is dropped.
+        Local<Object> window;
+        if(window_call)
+        {
+            RingState* state;
+            double* values;
+            if(!RingBuffer::Window(context, (size_t)x->m_window).ToLocal(&window)
+               || !RingBuffer::Open(window, state, values) || x->m_window_feed->Drain(state, values) == 0)
+            {
+                return Local<Value>();
+            }
+        }
+        
         Local<v8::Object> global = context->Global();
         MaybeLocal<Value> maybe_value = global->Get(context, v8::String::NewFromUtf8(isolate, s->s_name));
         
@@ -427,28 +1807,60 @@ namespace cicm
                 Local<v8::Function> fn = v8::Local<v8::Function>::Cast(value);
                 MaybeLocal<Value> result;
                 
-                Local<Value>* args = nullptr;
+                // small messages are marshaled on the stack, longer ones in a buffer of the
+                // instance that only grows. V8 copies the arguments when the call starts,
+                // so a handler calling back into this instance can reuse the buffer.
+                Local<Value> inline_args[kInlineArguments];
+                Local<Value>* args = inline_args;
                 
-                if(ac > 0)
+                if(ac > kInlineArguments)
                 {
-                    args = new Local<Value>[ac];
-                    for(long i = 0; i < ac; i++)
+                    if((long)x->m_long_args->size() < ac)
                     {
-                        switch (atom_gettype(av+i))
-                        {
-                            case A_LONG:  args[i] = v8::Integer::New(isolate, atom_getlong(av+i)); break;
-                            case A_FLOAT: args[i] = v8::Number::New(isolate, atom_getfloat(av+i)); break;
-                            case A_SYM:   args[i] = v8::String::NewFromUtf8(isolate, atom_getsym(av+i)->s_name); break;
-                            default: break;
-                        }
+                        x->m_long_args->resize(ac);
                     }
+                    args = &(*x->m_long_args)[0];
+                }
+                
+                AtomsToValues(isolate, ac, av, args);
+                if(window_call)
+                {
+                    args[0] = window;
+                    ac = 1;
+                }
+                
+                // outlets called by this handler measure their latency from its inlet.
+                const double outer_response = x->m_response_stamp;
+                const double started = LatencyNow();
+                if(dispatched > 0.)
+                {
+                    x->m_latency_stats->wait.Add(started - dispatched);
+                    x->m_response_stamp = dispatched;
                 }
                 
-                result = fn->Call(context, fn, ac, args);
+                x->m_watchdog->Arm(isolate, s, x->m_timeout);
+                result = fn->Call(context, fn, (int)ac, args);
+                if(x->m_watchdog->Disarm())
+                {
+                    x->reportTimeout(s);
+                }
+                
+                const double finished = LatencyNow();
+                if((Registry::Executed(&x->m_stats, finished - started) & (kHeapSampleInterval - 1)) == 0)
+                {
+                    SampleHeap(x, isolate);
+                }
                 
-                if (args)
+                if(dispatched > 0.)
                 {
-                    delete args;
+                    x->m_latency_stats->execution.Add(finished - started);
+                    x->m_response_stamp = outer_response;
+                    
+                    if(Tracer::Running())
+                    {
+                        Tracer::Span(gensym("queued"), "queue", x->m_trace_track, dispatched, started - dispatched);
+                        Tracer::Span(s, "js", x->m_trace_track, started, finished - started);
+                    }
                 }
                 
                 if(!result.IsEmpty())
@@ -464,7 +1876,7 @@ namespace cicm
                 }
                 else
                 {
-                    object_error((t_object*)x, "[%s] has no function named %s", x->m_filename, s->s_name);
+                    x->postError("[%s] has no function named %s", x->m_filename, s->s_name);
                 }
             }
         }
@@ -472,6 +1884,91 @@ namespace cicm
         return Local<Value>();
     }
     
+    void MaxV8::AtomsToValues(Isolate* isolate, long ac, t_atom *av, Local<Value>* args)
+    {
+        if(ac <= 0)
+        {
+            return;
+        }
+        
+        // homogeneous int or float lists (the common case for numeric streams)
+        // skip the per-atom type dispatch.
+        const long type = atom_gettype(av);
+        long same = 1;
+        while(same < ac && atom_gettype(av+same) == type)
+        {
+            same++;
+        }
+        
+        if(same == ac && type == A_LONG)
+        {
+            for(long i = 0; i < ac; i++)
+            {
+                const t_atom_long value = av[i].a_w.w_long;
+                if(value == (int32_t)value)
+                {
+                    args[i] = Integer::New(isolate, (int32_t)value);
+                }
+                else
+                {
+                    args[i] = Number::New(isolate, (double)value);
+                }
+            }
+        }
+        else if(same == ac && type == A_FLOAT)
+        {
+            for(long i = 0; i < ac; i++)
+            {
+                args[i] = Number::New(isolate, av[i].a_w.w_float);
+            }
+        }
+        else
+        {
+            for(long i = 0; i < ac; i++)
+            {
+                args[i] = AtomToValue(isolate, av+i);
+            }
+        }
+    }
+    
+    Local<Value> MaxV8::AtomToValue(Isolate* isolate, t_atom *av)
+    {
+        switch (atom_gettype(av))
+        {
+            case A_LONG:
+            {
+                const t_atom_long value = atom_getlong(av);
+                if(value == (int32_t)value)
+                {
+                    return Integer::New(isolate, (int32_t)value);
+                }
+                return Number::New(isolate, (double)value);
+            }
+            case A_FLOAT:   return Number::New(isolate, atom_getfloat(av));
+            case A_SYM:     return String::NewFromUtf8(isolate, atom_getsym(av)->s_name);
+            case A_OBJ:
+            {
+                // string objects are passed as JavaScript strings, other objects have no JS counterpart.
+                t_object* obj = (t_object*)atom_getobj(av);
+                if(obj && object_classname(obj) == gensym("string"))
+                {
+                    return String::NewFromUtf8(isolate, string_getptr((t_string*)obj));
+                }
+                return Null(isolate);
+            }
+            case A_DOLLAR:
+            {
+                char dollar[32];
+                snprintf_zero(dollar, sizeof(dollar), "$%ld", (long)av->a_w.w_long);
+                return String::NewFromUtf8(isolate, dollar);
+            }
+            case A_DOLLSYM: return String::NewFromUtf8(isolate, av->a_w.w_sym->s_name);
+            case A_SEMI:    return String::NewFromUtf8(isolate, ";");
+            case A_COMMA:   return String::NewFromUtf8(isolate, ",");
+            default:        return Undefined(isolate);
+        }
+    }
+    
     void MaxV8::JsArgumentsGetter(Local<String> property, const PropertyCallbackInfo<Value>& info)
     {
         Isolate* isolate = info.GetIsolate();
@@ -492,13 +1989,7 @@ namespace cicm
             {
                 for(long i = 0; i < x->m_obj_argc; i++)
                 {
-                    switch (atom_gettype(x->m_obj_argv+i))
-                    {
-                        case A_LONG:  array->Set(i, Integer::New(isolate, atom_getlong(x->m_obj_argv+i))); break;
-                        case A_FLOAT: array->Set(i, Number::New(isolate, atom_getfloat(x->m_obj_argv+i))); break;
-                        case A_SYM:   array->Set(i, String::NewFromUtf8(isolate, atom_getsym(x->m_obj_argv+i)->s_name)); break;
-                        default: break;
-                    }
+                    array->Set((uint32_t)i, AtomToValue(isolate, x->m_obj_argv+i));
                 }
                 
                 info.GetReturnValue().Set(array);
@@ -514,7 +2005,8 @@ namespace cicm
         Local<External> data = Local<External>::Cast(info.Data());
         MaxV8* x = static_cast<MaxV8*>(data->Value());
         
-        long inlet = proxy_getinlet((t_object*)x);
+        // a queued message has left its inlet, the inlet number travelled with it.
+        long inlet = x->m_inlet_captured ? x->m_current_inlet : proxy_getinlet((t_object*)x);
         
         Local<Number> l_inlet = Number::New(info.GetIsolate(), inlet);
         
@@ -616,160 +2108,375 @@ namespace cicm
             }
         }
         
-        args.GetReturnValue().Set(Local<Array>());
+        args.GetReturnValue().Set(Local<Array>());
+    }
+    
+    void MaxV8::AppendAtoms(MaxV8* x, Local<Context> context, Local<Value> value, vector<t_atom>& argv, size_t first)
+    {
+        Isolate::Scope isolate_scope(context->GetIsolate());
+        HandleScope handle_scope(context->GetIsolate());
+        
+        t_atom av;
+        if(value->IsNumber())
+        {
+            if(value->IsInt32() || value->IsUint32())
+            {
+                Maybe<int64_t> val = value->IntegerValue(context);
+                if(val.IsJust())
+                {
+                    atom_setlong(&av, val.FromJust());
+                    argv.push_back(av);
+                }
+            }
+            else
+            {
+                Maybe<double> val = value->NumberValue(context);
+                if(val.IsJust())
+                {
+                    atom_setfloat(&av, val.FromJust());
+                    argv.push_back(av);
+                }
+            }
+        }
+        else if(value->IsUndefined())
+        {
+            atom_setsym(&av, gensym("undefined"));
+            argv.push_back(av);
+        }
+        else if(value->IsNull())
+        {
+            atom_setsym(&av, gensym("null"));
+            argv.push_back(av);
+        }
+        else if(value->IsArray())
+        {
+            Local<Array> array = Local<Array>::Cast(value);
+            for (uint32_t i = 0; i < array->Length(); i++)
+            {
+                MaybeLocal<Value> obj = array->Get(context, Integer::New(context->GetIsolate(), i));
+                if(!obj.IsEmpty())
+                {
+                    AppendAtoms(x, context, obj.ToLocalChecked(), argv, first);
+                }
+            }
+        }
+        else if(value->IsString())
+        {
+            v8::String::Utf8Value str(value);
+            x->StringToAtom(ToCString(str), &av, argv.size() == first);
+            argv.push_back(av);
+        }
+    }
+    
+    void MaxV8::StringToAtom(const char* text, t_atom* av, bool leading)
+    {
+        bool as_symbol = (m_stringmode == kStringsAsSymbols);
+        
+        if(m_stringmode == kStringsAuto)
+        {
+            // short words make a bounded vocabulary, symbols are fine for them. Text with
+            // digits (times, counters, numbers, JSON) is likely unique and would only
+            // grow the symbol table, unless it leads the message: selectors such as
+            // "note1" or "bus2" must stay symbols to be routed.
+            const size_t length = strlen(text);
+            as_symbol = length <= kAutoSymbolLength && (leading || strpbrk(text, "0123456789") == nullptr);
+        }
+        
+        if(as_symbol)
+        {
+            atom_setsym(av, gensym(text));
+        }
+        else
+        {
+            // a new string per message: once sent it belongs to the receiver, which may keep
+            // the atom for as long as it likes, so it's never reused or freed here.
+            atom_setobj(av, string_new(text));
+        }
+    }
+    
+    void MaxV8::FreeStrings(long argc, t_atom* argv)
+    {
+        for(long i = 0; i < argc; i++)
+        {
+            if(atom_gettype(argv + i) == A_OBJ)
+            {
+                object_free(atom_getobj(argv + i));
+            }
+        }
+    }
+    
+    void MaxV8::JsOutput(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        Isolate::Scope isolate_scope(isolate);
+        HandleScope handle_scope(isolate);
+        
+        if (args.Length() < 2)
+        {
+            isolate->ThrowException(String::NewFromUtf8(isolate, "outlet need at least 2 parameters"));
+            return;
+        }
+        
+        Local<External> data = Local<External>::Cast(args.Data());
+        MaxV8* x = static_cast<MaxV8*>(data->Value());
+        
+        long index = 0;
+        if(!OutletIndex(isolate, x, args[0], index))
+        {
+            return;
+        }
+        
+        Local<Context> context = isolate->GetCurrentContext();
+        
+        vector<t_atom> argv_vec;
+        
+        for(int i = 1; i < args.Length(); i++)
+        {
+            AppendAtoms(x, context, args[i], argv_vec);
+        }
+        
+        Output(x, index, (long)argv_vec.size(), argv_vec.empty() ? NULL : &argv_vec[0]);
+    }
+    
+    bool MaxV8::OutletIndex(Isolate* isolate, MaxV8* x, Local<Value> value, long& index)
+    {
+        Maybe<double> may_num = value->NumberValue(isolate->GetCurrentContext());
+        if(may_num.IsJust())
+        {
+            index = may_num.FromJust();
+            if (index >= 0 && index < x->m_number_of_outlets)
+            {
+                return true;
+            }
+        }
+        
+        isolate->ThrowException(String::NewFromUtf8(isolate, "Bad index"));
+        return false;
     }
     
-    vector<t_atom> MaxV8::ValueToAtomVector(Local<Context> context, Local<Value> value)
+    void MaxV8::Output(MaxV8* x, long index, long argc, t_atom* argv)
     {
-        Isolate::Scope isolate_scope(context->GetIsolate());
-        HandleScope handle_scope(context->GetIsolate());
-        vector<t_atom> argv;
-        
-        t_atom av;
-        if(value->IsNumber())
+        if(x->m_response_stamp > 0.)
         {
-            if(value->IsInt32() || value->IsUint32())
-            {
-                Maybe<int64_t> val = value->IntegerValue(context);
-                if(val.IsJust())
-                {
-                    atom_setlong(&av, val.FromJust());
-                    argv.push_back(av);
-                }
-            }
-            else
+            const double now = LatencyNow();
+            x->m_latency_stats->response.Add(now - x->m_response_stamp);
+            if(Tracer::Running())
             {
-                Maybe<double> val = value->NumberValue(context);
-                if(val.IsJust())
-                {
-                    atom_setfloat(&av, val.FromJust());
-                    argv.push_back(av);
-                }
+                Tracer::Instant(gensym("outlet"), "outlet", x->m_trace_track, now, index);
             }
         }
-        else if(value->IsUndefined())
+        
+        if(x->m_in_worker)
         {
-            atom_setsym(&av, gensym("undefined"));
-            argv.push_back(av);
+            // outlets can't be called from a worker, replay the call on the thread the message came from.
+            // the strings travel with the queued call and are handed over when it is sent.
+            x->m_outbox[x->m_current_origin]->Push(NULL, index, x->m_current_origin, argc, argv);
         }
-        else if(value->IsNull())
+        else
         {
-            atom_setsym(&av, gensym("null"));
-            argv.push_back(av);
+            Emit(x, index, argc, argv);
         }
-        else if(value->IsArray())
+    }
+    
+    void MaxV8::JsOutletEmit(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        
+        if(args.Length() < 1 || !args[0]->IsArray())
         {
-            Local<Array> array = Local<Array>::Cast(value);
-            for (uint32_t i = 0; i < array->Length(); i++)
+            isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "outlet.emit needs an array of [index, values...] arrays")));
+            return;
+        }
+        
+        struct Span
+        {
+            long    index;
+            size_t  start;
+            size_t  count;
+        };
+        
+        Local<Array> calls = Local<Array>::Cast(args[0]);
+        const uint32_t ncalls = calls->Length();
+        vector<Span> spans;
+        vector<t_atom> atoms;
+        spans.reserve(ncalls);
+        
+        // everything is checked and converted before the first outlet fires.
+        bool valid = true;
+        for(uint32_t i = 0; valid && i < ncalls; i++)
+        {
+            Local<Value> call;
+            if(!calls->Get(context, i).ToLocal(&call))
             {
-                MaybeLocal<Value> obj = array->Get(context, Integer::New(context->GetIsolate(), i));
-                if(!obj.IsEmpty())
+                valid = false;
+                break;
+            }
+            
+            if(!call->IsArray() || Local<Array>::Cast(call)->Length() < 1)
+            {
+                isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "outlet.emit needs an array of [index, values...] arrays")));
+                valid = false;
+                break;
+            }
+            
+            Local<Array> values = Local<Array>::Cast(call);
+            Local<Value> value;
+            Span span;
+            if(!values->Get(context, 0).ToLocal(&value) || !OutletIndex(isolate, x, value, span.index))
+            {
+                valid = false;
+                break;
+            }
+            
+            span.start = atoms.size();
+            for(uint32_t j = 1; valid && j < values->Length(); j++)
+            {
+                if(!values->Get(context, j).ToLocal(&value))
                 {
-                    vector<t_atom> temp_argv = ValueToAtomVector(context, obj.ToLocalChecked());
-                    if (!temp_argv.empty())
-                    {
-                        argv.insert(argv.end(), temp_argv.begin(), temp_argv.end());
-                    }
+                    valid = false;
+                    break;
                 }
+                AppendAtoms(x, context, value, atoms, span.start);
+            }
+            span.count = atoms.size() - span.start;
+            
+            // right-to-left, calls to the same outlet keep their order.
+            vector<Span>::iterator it = spans.begin();
+            while(it != spans.end() && it->index >= span.index)
+            {
+                ++it;
             }
+            spans.insert(it, span);
         }
-        else if(value->IsString())
+        
+        if(!valid)
         {
-            v8::String::Utf8Value str(value);
-            atom_setsym(&av, gensym(ToCString(str)));
-            argv.push_back(av);
+            // nothing is sent, the strings converted so far are still ours.
+            FreeStrings((long)atoms.size(), atoms.empty() ? NULL : &atoms[0]);
+            return;
         }
         
-        return argv;
+        for(vector<Span>::iterator it = spans.begin(); it != spans.end(); ++it)
+        {
+            Output(x, it->index, (long)it->count, it->count ? &atoms[it->start] : NULL);
+        }
     }
     
-    void MaxV8::JsOutput(FunctionCallbackInfo<Value> const& args)
+    void MaxV8::JsOutletBind(FunctionCallbackInfo<Value> const& args)
     {
         Isolate* isolate = args.GetIsolate();
-        Isolate::Scope isolate_scope(isolate);
         HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
         
-        if (args.Length() < 2)
+        // outlet.bind(thisArg, ...) keeps its usual meaning.
+        if(args.Length() != 1 || !args[0]->IsNumber())
         {
-            isolate->ThrowException(String::NewFromUtf8(isolate, "outlet need at least 2 parameters"));
+            Local<Value> function, prototype, bind;
+            if(!context->Global()->Get(context, String::NewFromUtf8(isolate, "Function")).ToLocal(&function)
+               || !Local<Object>::Cast(function)->Get(context, String::NewFromUtf8(isolate, "prototype")).ToLocal(&prototype)
+               || !Local<Object>::Cast(prototype)->Get(context, String::NewFromUtf8(isolate, "bind")).ToLocal(&bind) || !bind->IsFunction())
+            {
+                return;
+            }
+            
+            vector<Local<Value> > bind_args(args.Length());
+            for(int i = 0; i < args.Length(); i++)
+            {
+                bind_args[i] = args[i];
+            }
+            
+            Local<Value> bound;
+            if(Local<Function>::Cast(bind)->Call(context, args.This(), args.Length(), bind_args.empty() ? NULL : &bind_args[0]).ToLocal(&bound))
+            {
+                args.GetReturnValue().Set(bound);
+            }
             return;
         }
         
-        Local<External> data = Local<External>::Cast(args.Data());
-        MaxV8* x = static_cast<MaxV8*>(data->Value());
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        long index;
+        if(!OutletIndex(isolate, x, args[0], index))
+        {
+            return;
+        }
         
-        long index = 0;
+        Local<Array> data = Array::New(isolate, 2);
+        data->Set(context, 0, args.Data()).FromMaybe(false);
+        data->Set(context, 1, Integer::New(isolate, (int)index)).FromMaybe(false);
         
-        Maybe<double> may_num = args[0]->NumberValue(isolate->GetCurrentContext());
-        if(may_num.IsJust())
+        Local<Function> handle;
+        if(Function::New(context, JsOutletBound, data).ToLocal(&handle))
         {
-            index = may_num.FromJust();
-            if (index < 0 || index >= x->m_number_of_outlets)
-            {
-                isolate->ThrowException(String::NewFromUtf8(isolate, "Bad index"));
-                return;
-            }
+            args.GetReturnValue().Set(handle);
         }
-        else
+    }
+    
+    void MaxV8::JsOutletBound(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        
+        Local<Array> data = Local<Array>::Cast(args.Data());
+        Local<Value> external, index;
+        if(!data->Get(context, 0).ToLocal(&external) || !data->Get(context, 1).ToLocal(&index))
         {
-            isolate->ThrowException(String::NewFromUtf8(isolate, "Bad index"));
             return;
         }
         
-        Local<Context> context = isolate->GetCurrentContext();
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(external)->Value());
+        const long outlet = (long)Local<Integer>::Cast(index)->Value();
+        
+        // the outlets may have been resized since the handle was made.
+        if(outlet >= x->m_number_of_outlets)
+        {
+            isolate->ThrowException(String::NewFromUtf8(isolate, "Bad index"));
+            return;
+        }
         
         vector<t_atom> argv_vec;
+        for(int i = 0; i < args.Length(); i++)
+        {
+            AppendAtoms(x, context, args[i], argv_vec);
+        }
         
-        for(int i = 1; i < args.Length(); i++)
+        Output(x, outlet, (long)argv_vec.size(), argv_vec.empty() ? NULL : &argv_vec[0]);
+    }
+    
+    void MaxV8::Emit(MaxV8* x, long index, long argc, t_atom* argv_vec)
+    {
+        // the outlets may have been resized since a queued call was recorded.
+        if(index < 0 || index >= (long)x->m_outlets.size())
         {
-            vector<t_atom> temp_argv = ValueToAtomVector(context, args[i]);
-            if (!temp_argv.empty())
-            {
-                argv_vec.insert(argv_vec.end(), temp_argv.begin(), temp_argv.end());
-            }
+            return;
         }
         
-        const short argc = argv_vec.size();
+        void* outlet = x->m_outlets[index];
         
         if(argc > 1)
         {
-            if (atom_gettype(&argv_vec[0]) == A_SYM)
+            if (atom_gettype(argv_vec) == A_SYM)
             {
-                t_atom* argv = new t_atom[argc-1];
-                
-                t_symbol* sym = atom_getsym(&argv_vec[0]);
-                
-                for(short i = 1; i < argc; i++)
-                {
-                    argv[i-1] = argv_vec[i];
-                }
-                
-                outlet_anything(x->m_outlets[index], sym, argc-1, argv);
-                delete argv;
+                outlet_anything(outlet, atom_getsym(argv_vec), (short)(argc-1), argv_vec+1);
             }
             else
             {
-                t_atom* argv = new t_atom[argc];
-                
-                for(short i = 0; i < argc; i++)
-                {
-                    argv[i] = argv_vec[i];
-                }
-                
-                outlet_list(x->m_outlets[index], 0L, argc, argv);
-                delete argv;
+                outlet_list(outlet, 0L, (short)argc, argv_vec);
             }
         }
         else
         {
             if(argc == 1)
             {
-                t_atom argv = argv_vec[0];
-                switch (atom_gettype(&argv))
+                switch (atom_gettype(argv_vec))
                 {
-                    case A_LONG:    outlet_int(x->m_outlets[index], atom_getlong(&argv)); break;
-                    case A_FLOAT:   outlet_float(x->m_outlets[index], atom_getfloat(&argv)); break;
-                    case A_SYM:     outlet_anything(x->m_outlets[index], atom_getsym(&argv), 0, NULL); break;
+                    case A_LONG:    outlet_int(outlet, atom_getlong(argv_vec)); break;
+                    case A_FLOAT:   outlet_float(outlet, atom_getfloat(argv_vec)); break;
+                    case A_SYM:     outlet_anything(outlet, atom_getsym(argv_vec), 0, NULL); break;
+                    case A_OBJ:     outlet_list(outlet, 0L, 1, argv_vec); break;
                     default: break;
                 }
             }
@@ -847,12 +2554,255 @@ namespace cicm
         return *value ? *value : "<string conversion failed>";
     }
     
+    void MaxV8::JsChannelOpen(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        
+        if(args.Length() < 1 || !args[0]->IsString())
+        {
+            isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Channel.open needs a channel name")));
+            return;
+        }
+        
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        
+        Local<ObjectTemplate> endpoint_template = ObjectTemplate::New(isolate);
+        endpoint_template->SetInternalFieldCount(1);
+        endpoint_template->Set(String::NewFromUtf8(isolate, "send"), FunctionTemplate::New(isolate, JsChannelSend));
+        endpoint_template->Set(String::NewFromUtf8(isolate, "close"), FunctionTemplate::New(isolate, JsChannelClose));
+        
+        Local<Object> object;
+        if(!endpoint_template->NewInstance(context).ToLocal(&object))
+        {
+            return;
+        }
+        
+        String::Utf8Value name(args[0]);
+        object->Set(context, String::NewFromUtf8(isolate, "name"), args[0]).FromMaybe(false);
+        
+        ChannelEndpoint* endpoint = Channel::Open(gensym(ToCString(name)), isolate, object, x->m_allocator, x->m_mailbox);
+        object->SetAlignedPointerInInternalField(0, endpoint);
+        
+        args.GetReturnValue().Set(object);
+    }
+    
+    static ChannelEndpoint* EndpointFromThis(FunctionCallbackInfo<Value> const& args)
+    {
+        Local<Object> self = args.This();
+        ChannelEndpoint* endpoint = nullptr;
+        if(self->InternalFieldCount() == 1)
+        {
+            endpoint = static_cast<ChannelEndpoint*>(self->GetAlignedPointerFromInternalField(0));
+        }
+        
+        if(!endpoint)
+        {
+            Isolate* isolate = args.GetIsolate();
+            isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, "channel is closed")));
+        }
+        
+        return endpoint;
+    }
+    
+    void MaxV8::JsChannelSend(FunctionCallbackInfo<Value> const& args)
+    {
+        HandleScope handle_scope(args.GetIsolate());
+        
+        ChannelEndpoint* endpoint = EndpointFromThis(args);
+        if(endpoint)
+        {
+            // on failure the clone error is left pending for the script.
+            Channel::Send(endpoint, args.GetIsolate()->GetCurrentContext(), args[0],
+                          args.Length() > 1 ? args[1] : Local<Value>());
+        }
+    }
+    
+    void MaxV8::JsChannelClose(FunctionCallbackInfo<Value> const& args)
+    {
+        HandleScope handle_scope(args.GetIsolate());
+        
+        ChannelEndpoint* endpoint = EndpointFromThis(args);
+        if(endpoint)
+        {
+            Channel::Close(endpoint);
+        }
+    }
+    
+    void MaxV8::JsCompile(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        
+        if(args.Length() < 1 || !args[0]->IsString())
+        {
+            isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "compile needs a source string")));
+            return;
+        }
+        
+        vector<Local<String>> params;
+        for(int i = 1; i < args.Length(); i++)
+        {
+            if(!args[i]->IsString())
+            {
+                isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "compile parameter names must be strings")));
+                return;
+            }
+            params.push_back(Local<String>::Cast(args[i]));
+        }
+        
+        Local<Function> function;
+        if(x->m_compile_cache->Get(context, Local<String>::Cast(args[0]), params).ToLocal(&function))
+        {
+            args.GetReturnValue().Set(function);
+        }
+    }
+    
+    void MaxV8::JsCompileStats(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        
+        ExpressionCache::Counters const& counters = x->m_compile_cache->GetCounters();
+        const struct {const char* name; double value;} fields[] =
+        {
+            {"hits",            (double)counters.hits},
+            {"misses",          (double)counters.misses},
+            {"evictions",       (double)counters.evictions},
+            {"codeHits",        (double)counters.code_hits},
+            {"codeRejected",    (double)counters.code_rejected},
+            {"size",            (double)x->m_compile_cache->Size()},
+            {"capacity",        (double)ExpressionCache::kCapacity},
+            {"codeCaches",      (double)ExpressionCache::CodeCaches()}
+        };
+        
+        Local<Object> stats = Object::New(isolate);
+        for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+        {
+            stats->Set(context, String::NewFromUtf8(isolate, fields[i].name), Number::New(isolate, fields[i].value)).FromMaybe(false);
+        }
+        args.GetReturnValue().Set(stats);
+    }
+    
+    void MaxV8::JsCompileClear(FunctionCallbackInfo<Value> const& args)
+    {
+        MaxV8* x = static_cast<MaxV8*>(Local<External>::Cast(args.Data())->Value());
+        x->m_compile_cache->Clear();
+    }
+    
+    void MaxV8::JsLoadWasm(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        
+        if(args.Length() < 1 || !args[0]->IsString())
+        {
+            isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "loadwasm needs a file name")));
+            return;
+        }
+        
+        // files are found in the search path, like scripts.
+        String::Utf8Value name(args[0]);
+        char filename[MAX_PATH_CHARS];
+        char abs_path[MAX_PATH_CHARS];
+        short path;
+        t_fourcc type;
+        strncpy_zero(filename, ToCString(name), MAX_FILENAME_CHARS);
+        
+        if(locatefile_extended(filename, &path, &type, nullptr, 0) || path_toabsolutesystempath(path, filename, abs_path))
+        {
+            string error = string("can't find file ") + filename;
+            isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, error.c_str())));
+            return;
+        }
+        
+        string error;
+        Local<WasmCompiledModule> module;
+        if(!WasmCache::Load(isolate, abs_path, error).ToLocal(&module))
+        {
+            if(!error.empty())
+            {
+                isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, error.c_str())));
+            }
+            return;
+        }
+        
+        Local<Value> wasm, instance_ctor, exports, memory;
+        Local<Object> instance;
+        Local<Value> instance_args[2] = {module, args.Length() > 1 ? args[1] : Local<Value>::Cast(Undefined(isolate))};
+        if(!context->Global()->Get(context, String::NewFromUtf8(isolate, "WebAssembly")).ToLocal(&wasm) || !wasm->IsObject()
+           || !Local<Object>::Cast(wasm)->Get(context, String::NewFromUtf8(isolate, "Instance")).ToLocal(&instance_ctor) || !instance_ctor->IsFunction()
+           || !Local<Function>::Cast(instance_ctor)->NewInstance(context, 2, instance_args).ToLocal(&instance)
+           || !instance->Get(context, String::NewFromUtf8(isolate, "exports")).ToLocal(&exports)
+           || !Local<Object>::Cast(exports)->Get(context, String::NewFromUtf8(isolate, "memory")).ToLocal(&memory))
+        {
+            return;
+        }
+        
+        // the views are made on access, the memory buffer changes when it grows.
+        Local<ObjectTemplate> result_template = ObjectTemplate::New(isolate);
+        const char* views[] = {"u8", "i32", "f32", "f64"};
+        for(int i = 0; i < 4; i++)
+        {
+            result_template->SetAccessor(String::NewFromUtf8(isolate, views[i]), JsWasmView, nullptr, Integer::New(isolate, i));
+        }
+        
+        Local<Object> result;
+        if(!result_template->NewInstance(context).ToLocal(&result))
+        {
+            return;
+        }
+        
+        result->Set(context, String::NewFromUtf8(isolate, "module"), module).FromMaybe(false);
+        result->Set(context, String::NewFromUtf8(isolate, "instance"), instance).FromMaybe(false);
+        result->Set(context, String::NewFromUtf8(isolate, "exports"), exports).FromMaybe(false);
+        result->Set(context, String::NewFromUtf8(isolate, "memory"), memory).FromMaybe(false);
+        
+        args.GetReturnValue().Set(result);
+    }
+    
+    void MaxV8::JsWasmView(Local<String> property, const PropertyCallbackInfo<Value>& info)
+    {
+        Isolate* isolate = info.GetIsolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = isolate->GetCurrentContext();
+        
+        Local<Value> memory, buffer;
+        if(!info.This()->Get(context, String::NewFromUtf8(isolate, "memory")).ToLocal(&memory) || !memory->IsObject()
+           || !Local<Object>::Cast(memory)->Get(context, String::NewFromUtf8(isolate, "buffer")).ToLocal(&buffer) || !buffer->IsArrayBuffer())
+        {
+            return;
+        }
+        
+        Local<ArrayBuffer> array_buffer = Local<ArrayBuffer>::Cast(buffer);
+        const size_t length = array_buffer->ByteLength();
+        
+        switch(Local<Integer>::Cast(info.Data())->Value())
+        {
+            case 0: info.GetReturnValue().Set(Uint8Array::New(array_buffer, 0, length)); break;
+            case 1: info.GetReturnValue().Set(Int32Array::New(array_buffer, 0, length / 4)); break;
+            case 2: info.GetReturnValue().Set(Float32Array::New(array_buffer, 0, length / 4)); break;
+            case 3: info.GetReturnValue().Set(Float64Array::New(array_buffer, 0, length / 8)); break;
+            default: break;
+        }
+    }
+    
     void MaxV8::JsPost(FunctionCallbackInfo<Value>const& args)
     {
         Isolate::Scope isolate_scope(args.GetIsolate());
         
         Local<External> data = Local<External>::Cast(args.Data());
         MaxV8* x = static_cast<MaxV8*>(data->Value());
+        if(x->m_log_level != kLogAll)
+        {
+            return;
+        }
         
         string postStr;
         for(int i = 0; i < args.Length(); i++)
@@ -871,7 +2821,7 @@ namespace cicm
             }
         }
         
-        object_post((t_object*)x, postStr.c_str());
+        x->m_console->Append(Console::kPost, postStr);
     }
     
     void MaxV8::JsError(FunctionCallbackInfo<Value>const& args)
@@ -880,6 +2830,10 @@ namespace cicm
         
         Local<External> data = Local<External>::Cast(args.Data());
         MaxV8* x = static_cast<MaxV8*>(data->Value());
+        if(x->m_log_level == kLogNone)
+        {
+            return;
+        }
         
         string postStr;
         for(int i = 0; i < args.Length(); i++)
@@ -898,6 +2852,6 @@ namespace cicm
             }
         }
         
-        object_error((t_object*)x, postStr.c_str());
+        x->m_console->Append(Console::kError, postStr);
     }
 }
@@ -21,21 +21,53 @@ extern "C"
 {
 #include "ext.h"
 #include "ext_obex.h"
+#include "ext_obstring.h"
+#include "ext_dictionary.h"
 }
 
 #include <map>
 #include <vector>
 #include <string>
 #include <iostream>
+#include <cstdio>
+#include <cstdarg>
 
 #include "include/v8.h"
 #include "include/libplatform/libplatform.h"
 
+#include "MaxV8Watchdog.h"
+#include "MaxV8Message.h"
+#include "MaxV8ThreadPool.h"
+#include "MaxV8Source.h"
+#include "MaxV8Allocator.h"
+#include "MaxV8Profile.h"
+#include "MaxV8Snapshot.h"
+#include "MaxV8Channel.h"
+#include "MaxV8Latency.h"
+#include "MaxV8JitDiag.h"
+#include "MaxV8Wasm.h"
+#include "MaxV8FileIO.h"
+#include "MaxV8Registry.h"
+#include "MaxV8Console.h"
+#include "MaxV8Ring.h"
+#include "MaxV8Compile.h"
+
 namespace cicm
 {
     using namespace v8;
     using namespace std;
     
+    struct ScriptLoad;
+    
+    //! The engine settings an isolate is created with, read on the main thread.
+    struct IsolateSettings
+    {
+        const Profile*  profile;
+        long            semi_space;
+        long            old_space;
+        bool            jitdiag;
+    };
+    
     class MaxV8
     {
     public:
@@ -45,6 +77,9 @@ namespace cicm
         //! Release v8.
         static void Release();
         
+        //! Declares the v8js attributes.
+        static void RegisterAttributes(t_class* c);
+        
         //! Allocates a new instance.
         static void* NewInstance(t_symbol* s, long argc, t_atom* argv);
         
@@ -72,6 +107,37 @@ namespace cicm
         //! bang method
         static void Anything(MaxV8* x, t_symbol *s, long ac, t_atom *av);
         
+        //! save the state object with the patcher
+        static void SaveState(MaxV8* x, t_dictionary* d);
+        
+        //! v8js.latency message: post the latency histograms, or reset them
+        static void Latency(MaxV8* x, t_symbol *s, long ac, t_atom *av);
+        
+        //! copies the latency histograms, and resets them if asked, the caller holds the isolate lock if any
+        static void TakeLatency(MaxV8* x, LatencyStats& stats, bool reset);
+        
+        //! v8js.trace message: start recording a Chrome trace file, or stop and write it
+        static void Trace(MaxV8* x, t_symbol *s, long ac, t_atom *av);
+        
+        //! v8js.jitreport message: post the functions optimized by the JIT, or reset the counts
+        static void JitReport(MaxV8* x, t_symbol *s, long ac, t_atom *av);
+        
+        //! jitdiag attribute setter
+        static t_max_err SetJitDiag(MaxV8* x, void* attr, long ac, t_atom* av);
+        
+        //! set the maximum number of console lines per second
+        static t_max_err SetLogRate(MaxV8* x, void* attr, long ac, t_atom* av);
+        
+        //! set the windowed inlet size or hop, the numbers waiting are dropped
+        static t_max_err SetWindow(MaxV8* x, void* attr, long ac, t_atom* av);
+        static t_max_err SetHop(MaxV8* x, void* attr, long ac, t_atom* av);
+        
+        //! v8js.top message: post the instances of the process ranked by execution time, or reset their counters
+        static void Top(MaxV8* x, t_symbol *s, long ac, t_atom *av);
+        
+        //! v8js.memory message: post the ArrayBuffer memory statistics
+        static void Memory(MaxV8* x);
+        
         //! method to open the text editor
         static void OpenEditor(MaxV8* x);
         
@@ -93,6 +159,7 @@ namespace cicm
         short               m_path;
         t_handle            m_text;
         long                m_textsize;
+        SourceBuffer*       m_source;
         t_object*           m_texteditor;
         vector<void*>       m_outlets;
         
@@ -102,8 +169,94 @@ namespace cicm
         map<int, string>    m_outlet_assist;
         
         bool                m_script_compiled;
+        long                m_timeout;
+        Watchdog::Entry*    m_watchdog;
+        
+        // parallel mode
+        enum { kOriginMain = 0, kOriginScheduler = 1, kNumOrigins = 2 };
+        char                m_parallel;
+        bool                m_in_worker;
+        t_int32_atomic      m_freeing;
+        t_systhread_mutex   m_idle_mutex;
+        t_systhread_cond    m_idle_cond;
+        long                m_current_inlet;
+        long                m_current_origin;
+        t_int32_atomic      m_scheduled;
+        t_int32_atomic      m_tasks;
+        MessageQueue*       m_inbox;
+        MessageQueue*       m_outbox[kNumOrigins];
+        t_int32_atomic      m_flush_pending[kNumOrigins];
+        void*               m_flush_qelem;
+        void*               m_flush_clock;
+        bool                m_inlet_captured;
+        
+        // outgoing strings
+        enum { kStringsAsSymbols = 0, kStringsAsStrings = 1, kStringsAuto = 2 };
+        enum { kAutoSymbolLength = 32 };
+        char                m_stringmode;
+        
+        // console output
+        enum { kLogAll = 0, kLogErrors = 1, kLogNone = 2 };
+        enum { kDefaultLogRate = 100 };
+        char                m_log_level;
+        long                m_log_rate;
+        Console*            m_console;
+        
+        // engine settings
+        t_symbol*           m_profile;
+        long                m_semi_space;
+        long                m_old_space;
+        
+        // cost accounting, the heap is sampled every kHeapSampleInterval handlers
+        enum { kHeapSampleInterval = 64 };
+        InstanceStats       m_stats;
+        
+        // latency measurement
+        char                m_latency;
+        double              m_call_stamp;
+        double              m_response_stamp;
+        long                m_trace_track;
+        LatencyStats*       m_latency_stats;
+        StampQueue*         m_deferred_stamps;
+        
+        // windowed inlet
+        long                m_window;
+        long                m_hop;
+        WindowFeed*         m_window_feed;
+        
+        // functions returned by compile()
+        ExpressionCache*    m_compile_cache;
+        
+        // arguments of handlers called with more than kInlineArguments atoms, used under the isolate lock
+        vector<Local<Value>>* m_long_args;
+        
+        // JIT diagnostics
+        char                m_jitdiag;
+        JitDiagnostics*     m_jit_diagnostics;
+        
+        // state snapshots
+        char                m_snapshot;
+        t_symbol*           m_state_name;
+        vector<uint8_t>*    m_saved_state;
+        
+        // background loading
+        bool                m_loading;
+        long                m_load_generation;
+        t_int32_atomic      m_loads_running;
+        MessageQueue*       m_pending;
+        ScriptLoad*         m_finished_load;
+        t_systhread_mutex   m_load_mutex;
+        void*               m_load_qelem;
         static v8::Platform *v8_platform;
         v8::Isolate*        m_isolate;
+        enum { kRetireInterval = 50 };
+        vector<Isolate*>*   m_retired_isolates;
+        void*               m_retire_qelem;
+        void*               m_retire_clock;
+        InstanceAllocator*  m_allocator;
+        Mailbox*            m_mailbox;
+        FileCompletions*    m_file_completions;
+        t_int32_atomic      m_io_running;
         v8::Persistent
         <v8::Context>       m_js_context;
         
@@ -111,15 +264,120 @@ namespace cicm
                 
         static void DoRead(MaxV8* x, t_symbol *s, long argc, t_atom *argv);
         
+        //! replace the script text with a copy of the given text
+        static void SetText(MaxV8* x, const char* text, long size);
+        
         // Creates a new execution environment containing the Max wrapped functions.
         Local<Context> createMaxContext(Isolate* isolate);
         
-        //! Compile and run the given script
-        Local<Value> compileAndRunScript(Isolate* isolate, Local<v8::String> script);
+        //! Compile the given script, reports errors
+        Local<Script> compileScript(Isolate* isolate, Local<v8::String> script);
+        
+        //! Run a compiled script, reports errors
+        Local<Value> runScript(Isolate* isolate, Local<Script> script);
+        
+        //! Decodes the state saved with the patcher and defines it as the read-only restoredState
+        //! global before the top level runs, undefined when there is none, must be called in the context
+        static Local<Value> ReadState(MaxV8 *x, Local<Context> context);
+        
+        //! Installs the restored state under the state name after the top level and calls
+        //! the script's optional restore function with it, must be called in the context
+        static void RestoreState(MaxV8 *x, Local<Context> context, Local<Value> state);
+        
+        //! Closes the channel endpoints of the current isolate, it must be locked and entered
+        static void CloseChannels(MaxV8* x);
+        
+        //! Calls the onmessage handlers of the channel endpoints with the values received
+        static void DeliverLetters(MaxV8* x);
+        
+        //! Thread pool task running a readFile or writeFile request
+        static void RunFileRequest(FileRequest* request);
+        
+        //! Settles the promises of the finished file requests
+        static void FinishFileRequests(MaxV8* x);
+        
+        //! Drops a file request whose script is gone
+        static void DiscardFileRequest(FileRequest* request);
+        
+        //! Gets the folder of the top level patcher, false if it has never been saved
+        static bool PatcherFolder(MaxV8* x, short* path);
+        
+        //! Updates the heap and ArrayBuffer figures of the instance stats, the isolate must be locked
+        static void SampleHeap(MaxV8* x, Isolate* isolate);
+        
+        //! Reads the engine attributes for the next isolate, reports an unknown profile
+        static void GetIsolateSettings(MaxV8 *x, IsolateSettings& settings);
+        
+        //! Creates an isolate configured for v8js, can be called from a worker
+        static Isolate* NewIsolate(MaxV8 *x, IsolateSettings const& settings);
+        
+        //! Waits for the current isolate to be idle and stops routing messages to it
+        static void RetireIsolate(MaxV8 *x);
+        
+        //! Disposes the retired isolates once no task or file request can reach them
+        static void DisposeRetired(MaxV8 *x);
+        static void RetryDisposeRetired(MaxV8 *x);
+        
+        //! Run the top level of a script and resize the inlets and outlets, the caller holds the isolate lock
+        static void RunTopLevel(MaxV8 *x, Local<Context> context, Local<Script> script);
+        
+        //! thread pool task reading, parsing and compiling a script file
+        static void LoadScript(ScriptLoad* load);
+        
+        //! runs a script compiled in the background on the main thread
+        static void FinishLoad(MaxV8 *x);
+        
+        //! releases a background load and its isolate
+        static void DiscardLoad(ScriptLoad* load);
+        
+        //! delivers the messages received while the script was loading
+        static void ReplayPending(MaxV8 *x);
+        
+        //! Reports a call terminated by the watchdog.
+        void reportTimeout(t_symbol* handler);
+        
+        //! Posts an error of the script through the console, after the lines it posted before.
+        void postError(const char* format, ...);
+        
+        //! replace the source of the loaded script, takes over the caller's reference
+        static void SetSource(MaxV8* x, SourceBuffer* source);
         
         //! Compile and run the current script
         static void CompileAndRun(MaxV8 *x);
         
+        //! hands an incoming message to the thread that runs the instance JavaScript
+        static void Dispatch(MaxV8* x, t_symbol *s, long ac, t_atom *av);
+        
+        //! deferred call carrying the arrival time of the message
+        static void CallDeferred(MaxV8* x, t_symbol *s, long ac, t_atom *av);
+        
+        //! queues a message for a parallel instance and schedules it on the thread pool
+        static void Enqueue(MaxV8* x, t_symbol *s, long inlet, long origin, long ac, t_atom *av, double stamp);
+        
+        //! thread pool task running the queued messages of a parallel instance
+        static void RunParallel(MaxV8* x);
+        
+        //! posts a RunParallel task, counted until it has returned
+        static void PostParallel(MaxV8* x);
+        
+        //! the last access of a worker to the instance, stops counting it and wakes up FreeInstance
+        static void WorkerDone(MaxV8* x, t_int32_atomic* counter);
+        
+        //! runs the queued messages, the caller holds the isolate lock
+        static void DrainInbox(MaxV8* x);
+        
+        //! replays the outlet calls a worker queued for the main thread
+        static void FlushMain(MaxV8* x);
+        
+        //! replays the outlet calls a worker queued for the scheduler
+        static void FlushScheduler(MaxV8* x);
+        
+        //! sends the queued outlet calls of one origin, in order
+        static void FlushOutbox(MaxV8* x, long origin);
+        
+        //! sends an atom list through an outlet
+        static void Emit(MaxV8* x, long index, long argc, t_atom* argv);
+        
         //! resize the inlets and outlets
         static void ResizeIO(MaxV8 *x, long last_ins, long new_ins, long last_outs, long new_outs);
         
@@ -130,6 +388,15 @@ namespace cicm
         //! call a named JavaScript function with arguments
         static Local<Value> CallJsFunction(MaxV8* x, t_symbol *s, long ac, t_atom *av);
         
+        //! number of arguments CallJsFunction marshals in its stack buffer
+        enum { kInlineArguments = 16 };
+        
+        //! convert an atom list to JavaScript values, args must hold ac slots
+        static void AtomsToValues(Isolate* isolate, long ac, t_atom *av, Local<Value>* args);
+        
+        //! convert a single atom to a JavaScript value (never empty)
+        static Local<Value> AtomToValue(Isolate* isolate, t_atom *av);
+        
         static void JsInletsGetter(Local<String> property, const PropertyCallbackInfo<Value>& info);
         static void JsInletsSetter(Local<String> property, Local<Value> value, const PropertyCallbackInfo<void>& info);
         
@@ -149,7 +416,26 @@ namespace cicm
         //! JavaScript 'outlet' function wrapper.
         static void JsArrayFromArgs(FunctionCallbackInfo<Value> const& args);
         
-        static vector<t_atom> ValueToAtomVector(Local<Context> context, Local<Value> value);
+        //! flattens a value at the end of an atom buffer, the message being built starts at first
+        static void AppendAtoms(MaxV8* x, Local<Context> context, Local<Value> value, vector<t_atom>& argv, size_t first = 0);
+        
+        //! outlet.emit(calls), outlet.bind(index) and bound outlet handle callbacks
+        static void JsOutletEmit(FunctionCallbackInfo<Value> const& args);
+        static void JsOutletBind(FunctionCallbackInfo<Value> const& args);
+        static void JsOutletBound(FunctionCallbackInfo<Value> const& args);
+        
+        //! reads and checks an outlet index, throws in the script if it is out of range
+        static bool OutletIndex(Isolate* isolate, MaxV8* x, Local<Value> value, long& index);
+        
+        //! sends atoms through an outlet now, or queues them when called from a worker
+        static void Output(MaxV8* x, long index, long argc, t_atom* argv);
+        
+        //! convert an outgoing string to a symbol or a new string object according to the stringmode,
+        //! leading is true for the first atom of a message
+        void StringToAtom(const char* text, t_atom* av, bool leading);
+        
+        //! frees the string objects of a message that was never sent, once sent they belong to the receiver
+        static void FreeStrings(long argc, t_atom* argv);
         
         //! @internal Extracts a C string from a V8 Utf8Value.
         static const char* ToCString(String::Utf8Value const& value);
@@ -157,6 +443,25 @@ namespace cicm
         //! JavaScript 'post' function wrapper.
         static void JsPost(FunctionCallbackInfo<Value> const& args);
         
+        //! JavaScript 'readFile' and 'writeFile' functions
+        static void StartFileRequest(FunctionCallbackInfo<Value> const& args, long kind);
+        static void JsReadFile(FunctionCallbackInfo<Value> const& args);
+        static void JsWriteFile(FunctionCallbackInfo<Value> const& args);
+        
+        //! JavaScript 'compile' function, with compile.stats() and compile.clear()
+        static void JsCompile(FunctionCallbackInfo<Value> const& args);
+        static void JsCompileStats(FunctionCallbackInfo<Value> const& args);
+        static void JsCompileClear(FunctionCallbackInfo<Value> const& args);
+        
+        //! JavaScript 'loadwasm' function and the typed array views of its memory
+        static void JsLoadWasm(FunctionCallbackInfo<Value> const& args);
+        static void JsWasmView(Local<String> property, const PropertyCallbackInfo<Value>& info);
+        
+        //! Channel.open(name), endpoint.send(value, transfer) and endpoint.close() callbacks
+        static void JsChannelOpen(FunctionCallbackInfo<Value> const& args);
+        static void JsChannelSend(FunctionCallbackInfo<Value> const& args);
+        static void JsChannelClose(FunctionCallbackInfo<Value> const& args);
+        
         //! JavaScript 'error' function wrapper.
         static void JsError(FunctionCallbackInfo<Value> const& args);
     };
@@ -0,0 +1,206 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+namespace cicm
+{
+    //! Adds delta to an atomic counter and returns the new value.
+    static int64_t AtomicAdd(t_int64_atomic* value, int64_t delta)
+    {
+        int64_t previous;
+        do
+        {
+            previous = *value;
+        }
+        while(!ATOMIC_COMPARE_SWAP64(previous, previous + delta, value));
+
+        return previous + delta;
+    }
+
+    //============================================================================
+    // BufferPool
+    //============================================================================
+
+    BufferPool::SizeClass BufferPool::s_classes[BufferPool::kNumClasses];
+
+    void BufferPool::Init()
+    {
+        for(long i = 0; i < kNumClasses; i++)
+        {
+            systhread_mutex_new(&s_classes[i].mutex, 0);
+            s_classes[i].head = nullptr;
+            s_classes[i].cached = 0;
+        }
+    }
+
+    long BufferPool::ClassOf(size_t length)
+    {
+        long index = 0;
+        while(((size_t)1 << (kMinClassShift + index)) < length)
+        {
+            index++;
+        }
+
+        return index;
+    }
+
+    void* BufferPool::Allocate(size_t length, bool zero)
+    {
+        if(IsLarge(length))
+        {
+            // anonymous pages are zero-filled on demand.
+            void* data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+            return data == MAP_FAILED ? nullptr : data;
+        }
+
+        const long index = ClassOf(length);
+        const size_t size = (size_t)1 << (kMinClassShift + index);
+        SizeClass& size_class = s_classes[index];
+
+        systhread_mutex_lock(size_class.mutex);
+        void* data = size_class.head;
+        if(data)
+        {
+            // free blocks are chained through their first word.
+            size_class.head = *(void**)data;
+            size_class.cached -= size;
+        }
+        systhread_mutex_unlock(size_class.mutex);
+
+        if(!data)
+        {
+            data = malloc(size);
+        }
+
+        if(data && zero)
+        {
+            memset(data, 0, length);
+        }
+
+        return data;
+    }
+
+    void BufferPool::Free(void* data, size_t length)
+    {
+        if(!data)
+        {
+            return;
+        }
+
+        if(IsLarge(length))
+        {
+            munmap(data, length);
+            return;
+        }
+
+        const long index = ClassOf(length);
+        const size_t size = (size_t)1 << (kMinClassShift + index);
+        SizeClass& size_class = s_classes[index];
+
+        systhread_mutex_lock(size_class.mutex);
+        if(size_class.cached + size <= kMaxCachedPerClass)
+        {
+            *(void**)data = size_class.head;
+            size_class.head = data;
+            size_class.cached += size;
+            data = nullptr;
+        }
+        systhread_mutex_unlock(size_class.mutex);
+
+        // the free list of this class is full, give the block back to the system.
+        if(data)
+        {
+            free(data);
+        }
+    }
+
+    int64_t BufferPool::CachedBytes()
+    {
+        int64_t total = 0;
+        for(long i = 0; i < kNumClasses; i++)
+        {
+            systhread_mutex_lock(s_classes[i].mutex);
+            total += s_classes[i].cached;
+            systhread_mutex_unlock(s_classes[i].mutex);
+        }
+
+        return total;
+    }
+
+    //============================================================================
+    // InstanceAllocator
+    //============================================================================
+
+    InstanceAllocator::InstanceAllocator() :
+    m_live_bytes(0),
+    m_peak_bytes(0),
+    m_live_buffers(0),
+    m_allocations(0)
+    {
+        ;
+    }
+
+    void* InstanceAllocator::Allocate(size_t length)
+    {
+        return Account(BufferPool::Allocate(length, true), length);
+    }
+
+    void* InstanceAllocator::AllocateUninitialized(size_t length)
+    {
+        return Account(BufferPool::Allocate(length, false), length);
+    }
+
+    void InstanceAllocator::Free(void* data, size_t length)
+    {
+        if(data)
+        {
+            AtomicAdd(&m_live_bytes, -(int64_t)length);
+            AtomicAdd(&m_live_buffers, -1);
+        }
+
+        BufferPool::Free(data, length);
+    }
+
+    void InstanceAllocator::Adopt(size_t length)
+    {
+        const int64_t live = AtomicAdd(&m_live_bytes, (int64_t)length);
+        AtomicAdd(&m_live_buffers, 1);
+        UpdatePeak(live);
+    }
+
+    void InstanceAllocator::Disown(size_t length)
+    {
+        AtomicAdd(&m_live_bytes, -(int64_t)length);
+        AtomicAdd(&m_live_buffers, -1);
+    }
+
+    void* InstanceAllocator::Account(void* data, size_t length)
+    {
+        if(data)
+        {
+            const int64_t live = AtomicAdd(&m_live_bytes, (int64_t)length);
+            AtomicAdd(&m_live_buffers, 1);
+            AtomicAdd(&m_allocations, 1);
+            UpdatePeak(live);
+        }
+
+        return data;
+    }
+
+    void InstanceAllocator::UpdatePeak(int64_t live)
+    {
+        int64_t peak = m_peak_bytes;
+        while(live > peak && !ATOMIC_COMPARE_SWAP64(peak, live, &m_peak_bytes))
+        {
+            peak = m_peak_bytes;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_ALLOCATOR_H_
+#define _MAX_V8_ALLOCATOR_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+#include "ext_atomic.h"
+}
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    //! A process-wide, thread-safe pool of ArrayBuffer backing stores.
+    //! @details Small buffers are rounded up to a power of two and recycled through
+    //! one free list per size class. Large buffers are mapped from the system, their
+    //! pages are zeroed on first touch so they never need a memset.
+    class BufferPool
+    {
+    public:
+
+        enum
+        {
+            kMinClassShift      = 6,            // 64 bytes
+            kMaxClassShift      = 16,           // 64 KB
+            kNumClasses         = kMaxClassShift - kMinClassShift + 1,
+            kMaxCachedPerClass  = 4 * 1024 * 1024
+        };
+
+        //! Creates the size classes.
+        static void Init();
+
+        //! Returns a buffer of at least length bytes, zeroed if zero is true.
+        static void* Allocate(size_t length, bool zero);
+
+        //! Gives back a buffer, length must be the length it was allocated with.
+        static void Free(void* data, size_t length);
+
+        //! Returns true if buffers of this length are mapped rather than pooled.
+        static bool IsLarge(size_t length) {return length > ((size_t)1 << kMaxClassShift);}
+
+        //! Bytes held by the free lists, ready for reuse.
+        static int64_t CachedBytes();
+
+    private:
+
+        struct SizeClass
+        {
+            t_systhread_mutex   mutex;
+            void*               head;
+            size_t              cached;
+        };
+
+        static long ClassOf(size_t length);
+
+        static SizeClass s_classes[kNumClasses];
+    };
+
+    //! The ArrayBuffer allocator of one v8js instance.
+    //! @details Serves every isolate of the instance from the BufferPool and
+    //! counts the bytes they hold. V8 may free buffers from its own threads, the
+    //! counters are therefore atomic.
+    class InstanceAllocator : public v8::ArrayBuffer::Allocator
+    {
+    public:
+        InstanceAllocator();
+
+        virtual void* Allocate(size_t length);
+        virtual void* AllocateUninitialized(size_t length);
+        virtual void Free(void* data, size_t length);
+
+        //! Accounts for a buffer of another instance handed over to this one.
+        void Adopt(size_t length);
+
+        //! Stops accounting for a buffer handed over to another instance.
+        void Disown(size_t length);
+
+        int64_t LiveBytes() const       {return m_live_bytes;}
+        int64_t PeakBytes() const       {return m_peak_bytes;}
+        int64_t LiveBuffers() const     {return m_live_buffers;}
+        int64_t Allocations() const     {return m_allocations;}
+
+    private:
+        void* Account(void* data, size_t length);
+        void UpdatePeak(int64_t live);
+
+        t_int64_atomic  m_live_bytes;
+        t_int64_atomic  m_peak_bytes;
+        t_int64_atomic  m_live_buffers;
+        t_int64_atomic  m_allocations;
+    };
+}
+
+#endif // _MAX_V8_ALLOCATOR_H_
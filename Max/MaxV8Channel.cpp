@@ -0,0 +1,353 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Channel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+namespace cicm
+{
+    //============================================================================
+    // Parcel
+    //============================================================================
+    
+    Parcel::Parcel() :
+    m_data(nullptr),
+    m_size(0),
+    m_taken(false),
+    m_refcount(1)
+    {
+        ;
+    }
+    
+    Parcel::~Parcel()
+    {
+        free(m_data);
+        
+        if(!m_taken)
+        {
+            for(vector<pair<void*, size_t> >::iterator it = m_buffers.begin(); it != m_buffers.end(); ++it)
+            {
+                BufferPool::Free(it->first, it->second);
+            }
+        }
+    }
+    
+    void Parcel::Retain()
+    {
+        ATOMIC_INCREMENT(&m_refcount);
+    }
+    
+    void Parcel::Release()
+    {
+        if(ATOMIC_DECREMENT(&m_refcount) == 0)
+        {
+            delete this;
+        }
+    }
+    
+    MaybeLocal<Value> Parcel::Open(Isolate* isolate, Local<Context> context, InstanceAllocator* allocator)
+    {
+        ValueDeserializer deserializer(isolate, m_data, m_size);
+        if(!deserializer.ReadHeader(context).FromMaybe(false))
+        {
+            return MaybeLocal<Value>();
+        }
+        
+        // parcels are opened on the main thread only, no other receiver can be reading the buffers.
+        const bool take = !m_taken && m_refcount == 1;
+        
+        for(size_t i = 0; i < m_buffers.size(); i++)
+        {
+            void* data = m_buffers[i].first;
+            const size_t length = m_buffers[i].second;
+            
+            Local<ArrayBuffer> buffer;
+            if(take)
+            {
+                buffer = ArrayBuffer::New(isolate, data, length, ArrayBufferCreationMode::kInternalized);
+                allocator->Adopt(length);
+            }
+            else
+            {
+                buffer = ArrayBuffer::New(isolate, length);
+                memcpy(buffer->GetContents().Data(), data, length);
+            }
+            
+            deserializer.TransferArrayBuffer((uint32_t)i, buffer);
+        }
+        
+        m_taken = m_taken || take;
+        
+        return deserializer.ReadValue(context);
+    }
+    
+    //============================================================================
+    // Mailbox
+    //============================================================================
+    
+    Mailbox::Mailbox(void* owner, method deliver) :
+    m_mutex(nullptr),
+    m_qelem(qelem_new(owner, deliver))
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+    
+    Mailbox::~Mailbox()
+    {
+        qelem_free(m_qelem);
+        systhread_mutex_free(m_mutex);
+    }
+    
+    void Mailbox::Post(Letter const& letter)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_letters.push_back(letter);
+        systhread_mutex_unlock(m_mutex);
+        
+        qelem_set(m_qelem);
+    }
+    
+    bool Mailbox::Take(Letter& letter)
+    {
+        systhread_mutex_lock(m_mutex);
+        const bool taken = !m_letters.empty();
+        if(taken)
+        {
+            letter = m_letters.front();
+            m_letters.pop_front();
+        }
+        systhread_mutex_unlock(m_mutex);
+        return taken;
+    }
+    
+    void Mailbox::Drop(ChannelEndpoint* endpoint)
+    {
+        deque<Letter> dropped;
+        
+        systhread_mutex_lock(m_mutex);
+        for(deque<Letter>::iterator it = m_letters.begin(); it != m_letters.end();)
+        {
+            if(it->endpoint == endpoint)
+            {
+                dropped.push_back(*it);
+                it = m_letters.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        systhread_mutex_unlock(m_mutex);
+        
+        for(deque<Letter>::iterator it = dropped.begin(); it != dropped.end(); ++it)
+        {
+            if(it->parcel)
+            {
+                it->parcel->Release();
+            }
+            delete it->value;
+        }
+    }
+    
+    void Mailbox::Add(ChannelEndpoint* endpoint)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_endpoints.push_back(endpoint);
+        systhread_mutex_unlock(m_mutex);
+    }
+    
+    void Mailbox::Remove(ChannelEndpoint* endpoint)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_endpoints.erase(remove(m_endpoints.begin(), m_endpoints.end(), endpoint), m_endpoints.end());
+        systhread_mutex_unlock(m_mutex);
+    }
+    
+    vector<ChannelEndpoint*> Mailbox::Endpoints()
+    {
+        systhread_mutex_lock(m_mutex);
+        vector<ChannelEndpoint*> endpoints = m_endpoints;
+        systhread_mutex_unlock(m_mutex);
+        return endpoints;
+    }
+    
+    //============================================================================
+    // Channel
+    //============================================================================
+    
+    map<t_symbol*, vector<ChannelEndpoint*> >   Channel::s_channels;
+    t_systhread_mutex                           Channel::s_mutex = nullptr;
+    
+    void Channel::Init()
+    {
+        systhread_mutex_new(&s_mutex, 0);
+    }
+    
+    ChannelEndpoint* Channel::Open(t_symbol* name, Isolate* isolate, Local<Object> object,
+                                   InstanceAllocator* allocator, Mailbox* mailbox)
+    {
+        ChannelEndpoint* endpoint = new ChannelEndpoint();
+        endpoint->name = name;
+        endpoint->isolate = isolate;
+        endpoint->allocator = allocator;
+        endpoint->mailbox = mailbox;
+        endpoint->object.Reset(isolate, object);
+        
+        mailbox->Add(endpoint);
+        
+        systhread_mutex_lock(s_mutex);
+        s_channels[name].push_back(endpoint);
+        systhread_mutex_unlock(s_mutex);
+        
+        return endpoint;
+    }
+    
+    void Channel::Close(ChannelEndpoint* endpoint)
+    {
+        // once unregistered no sender can post to the endpoint anymore.
+        systhread_mutex_lock(s_mutex);
+        vector<ChannelEndpoint*>& endpoints = s_channels[endpoint->name];
+        endpoints.erase(remove(endpoints.begin(), endpoints.end(), endpoint), endpoints.end());
+        if(endpoints.empty())
+        {
+            s_channels.erase(endpoint->name);
+        }
+        systhread_mutex_unlock(s_mutex);
+        
+        endpoint->mailbox->Drop(endpoint);
+        endpoint->mailbox->Remove(endpoint);
+        
+        HandleScope handle_scope(endpoint->isolate);
+        Local<Object> object = Local<Object>::New(endpoint->isolate, endpoint->object);
+        object->SetAlignedPointerInInternalField(0, nullptr);
+        endpoint->object.Reset();
+        
+        delete endpoint;
+    }
+    
+    Parcel* Channel::Pack(ChannelEndpoint* from, Local<Context> context, Local<Value> value, Local<Value> transfer)
+    {
+        Isolate* isolate = from->isolate;
+        ValueSerializer serializer(isolate);
+        vector<Local<ArrayBuffer> > transferred;
+        
+        if(!transfer.IsEmpty() && transfer->IsArray())
+        {
+            Local<Array> list = Local<Array>::Cast(transfer);
+            for(uint32_t i = 0; i < list->Length(); i++)
+            {
+                Local<Value> item;
+                if(!list->Get(context, i).ToLocal(&item))
+                {
+                    return nullptr;
+                }
+                
+                if(!item->IsArrayBuffer() || Local<ArrayBuffer>::Cast(item)->IsExternal()
+                   || !Local<ArrayBuffer>::Cast(item)->IsNeuterable())
+                {
+                    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "only ArrayBuffers owned by the script can be transferred")));
+                    return nullptr;
+                }
+                
+                Local<ArrayBuffer> buffer = Local<ArrayBuffer>::Cast(item);
+                serializer.TransferArrayBuffer((uint32_t)transferred.size(), buffer);
+                transferred.push_back(buffer);
+            }
+        }
+        
+        serializer.WriteHeader();
+        if(!serializer.WriteValue(context, value).FromMaybe(false))
+        {
+            return nullptr;
+        }
+        
+        Parcel* parcel = new Parcel();
+        pair<uint8_t*, size_t> buffer = serializer.Release();
+        parcel->m_data = buffer.first;
+        parcel->m_size = buffer.second;
+        
+        // the memory of the transferred buffers leaves the sender with the parcel.
+        for(vector<Local<ArrayBuffer> >::iterator it = transferred.begin(); it != transferred.end(); ++it)
+        {
+            ArrayBuffer::Contents contents = (*it)->Externalize();
+            (*it)->Neuter();
+            from->allocator->Disown(contents.ByteLength());
+            parcel->m_buffers.push_back(make_pair(contents.Data(), contents.ByteLength()));
+        }
+        
+        return parcel;
+    }
+    
+    bool Channel::Send(ChannelEndpoint* from, Local<Context> context, Local<Value> value, Local<Value> transfer)
+    {
+        // only the isolates are read under the lock, an endpoint may be closed once it is released.
+        bool remote = false;
+        systhread_mutex_lock(s_mutex);
+        map<t_symbol*, vector<ChannelEndpoint*> >::const_iterator channel = s_channels.find(from->name);
+        if(channel != s_channels.end())
+        {
+            for(vector<ChannelEndpoint*>::const_iterator it = channel->second.begin(); it != channel->second.end() && !remote; ++it)
+            {
+                remote = (*it)->isolate != from->isolate;
+            }
+        }
+        systhread_mutex_unlock(s_mutex);
+        
+        // serialization may run script getters, which may open channels: don't hold the lock.
+        Parcel* parcel = nullptr;
+        if(remote)
+        {
+            parcel = Pack(from, context, value, transfer);
+            if(!parcel)
+            {
+                return false;
+            }
+        }
+        
+        systhread_mutex_lock(s_mutex);
+        channel = s_channels.find(from->name);
+        const vector<ChannelEndpoint*> none;
+        vector<ChannelEndpoint*> const& endpoints = channel != s_channels.end() ? channel->second : none;
+        for(vector<ChannelEndpoint*>::const_iterator it = endpoints.begin(); it != endpoints.end(); ++it)
+        {
+            ChannelEndpoint* to = *it;
+            if(to == from)
+            {
+                continue;
+            }
+            
+            Letter letter = {to, nullptr, nullptr};
+            if(to->isolate == from->isolate)
+            {
+                // same heap, the value is shared as is.
+                letter.value = new Global<Value>(from->isolate, value);
+            }
+            else if(parcel)
+            {
+                parcel->Retain();
+                letter.parcel = parcel;
+            }
+            else
+            {
+                // opened in another isolate since the value was packed.
+                continue;
+            }
+            
+            to->mailbox->Post(letter);
+        }
+        systhread_mutex_unlock(s_mutex);
+        
+        if(parcel)
+        {
+            parcel->Release();
+        }
+        
+        return true;
+    }
+}
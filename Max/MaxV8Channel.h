@@ -0,0 +1,135 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_CHANNEL_H_
+#define _MAX_V8_CHANNEL_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+#include "ext_atomic.h"
+}
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "include/v8.h"
+
+#include "MaxV8Allocator.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+    
+    class Mailbox;
+    
+    //! One end of a named channel, created by Channel.open in a script.
+    struct ChannelEndpoint
+    {
+        t_symbol*           name;
+        Isolate*            isolate;
+        InstanceAllocator*  allocator;
+        Mailbox*            mailbox;
+        Global<Object>      object;
+    };
+    
+    //! A value cloned out of an isolate, shared by its receivers in other isolates.
+    //! @details Transferred ArrayBuffers are detached from the sender, the last
+    //! receiver takes their memory and the others get a copy.
+    class Parcel
+    {
+    public:
+        Parcel();
+        
+        void Retain();
+        void Release();
+        
+        //! Deserializes the value in the current context of isolate.
+        //! @details Returns an empty handle with a pending exception on failure.
+        MaybeLocal<Value> Open(Isolate* isolate, Local<Context> context, InstanceAllocator* allocator);
+        
+    private:
+        friend class Channel;
+        ~Parcel();
+        
+        uint8_t*                    m_data;
+        size_t                      m_size;
+        vector<pair<void*, size_t>> m_buffers;
+        bool                        m_taken;
+        t_int32_atomic              m_refcount;
+    };
+    
+    //! A message waiting to be delivered to an endpoint.
+    //! @details Receivers in the sender isolate get the value itself, the others a parcel.
+    struct Letter
+    {
+        ChannelEndpoint*    endpoint;
+        Parcel*             parcel;
+        Global<Value>*      value;
+    };
+    
+    //! The letters and endpoints of one instance.
+    //! @details Letters can be posted from any thread, the owner is notified with a qelem
+    //! and takes them on the main thread.
+    class Mailbox
+    {
+    public:
+        Mailbox(void* owner, method deliver);
+        ~Mailbox();
+        
+        void Post(Letter const& letter);
+        bool Take(Letter& letter);
+        
+        //! Discards the letters of an endpoint, its isolate must be locked.
+        void Drop(ChannelEndpoint* endpoint);
+        
+        void Add(ChannelEndpoint* endpoint);
+        void Remove(ChannelEndpoint* endpoint);
+        vector<ChannelEndpoint*> Endpoints();
+        
+    private:
+        t_systhread_mutex           m_mutex;
+        deque<Letter>               m_letters;
+        vector<ChannelEndpoint*>    m_endpoints;
+        void*                       m_qelem;
+    };
+    
+    //! The process-wide registry of named channels.
+    //! @details Every value sent on a channel is delivered to all the other endpoints
+    //! opened with the same name, in any instance.
+    class Channel
+    {
+    public:
+        
+        static void Init();
+        
+        //! Opens an endpoint, the isolate must be locked.
+        static ChannelEndpoint* Open(t_symbol* name, Isolate* isolate, Local<Object> object,
+                                     InstanceAllocator* allocator, Mailbox* mailbox);
+        
+        //! Closes and deletes an endpoint, the isolate must be locked and entered.
+        static void Close(ChannelEndpoint* endpoint);
+        
+        //! Sends a value to the other endpoints of the channel.
+        //! @details transfer may be an array of ArrayBuffers moved rather than copied to the
+        //! receivers of other isolates. Returns false with a pending exception on failure.
+        static bool Send(ChannelEndpoint* from, Local<Context> context, Local<Value> value, Local<Value> transfer);
+        
+    private:
+        
+        static Parcel* Pack(ChannelEndpoint* from, Local<Context> context, Local<Value> value, Local<Value> transfer);
+        
+        static map<t_symbol*, vector<ChannelEndpoint*> >    s_channels;
+        static t_systhread_mutex                            s_mutex;
+    };
+}
+
+#endif // _MAX_V8_CHANNEL_H_
@@ -0,0 +1,240 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Compile.h"
+
+#include <utility>
+
+namespace cicm
+{
+    map<uint64_t, ExpressionCache::Code>    ExpressionCache::s_code;
+    deque<uint64_t>                         ExpressionCache::s_code_order;
+    t_systhread_mutex                       ExpressionCache::s_mutex = nullptr;
+
+    void ExpressionCache::Init()
+    {
+        systhread_mutex_new(&s_mutex, 0);
+    }
+
+    void ExpressionCache::Release()
+    {
+        s_code.clear();
+        s_code_order.clear();
+        systhread_mutex_free(s_mutex);
+    }
+
+    size_t ExpressionCache::CodeCaches()
+    {
+        systhread_mutex_lock(s_mutex);
+        const size_t count = s_code.size();
+        systhread_mutex_unlock(s_mutex);
+        return count;
+    }
+
+    uint64_t ExpressionCache::Hash(string const& key)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < key.size(); i++)
+        {
+            hash = (hash ^ (uint8_t)key[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    ExpressionCache::ExpressionCache()
+    {
+        m_counters.hits = m_counters.misses = m_counters.evictions = 0;
+        m_counters.code_hits = m_counters.code_rejected = 0;
+    }
+
+    ExpressionCache::~ExpressionCache()
+    {
+        ;
+    }
+
+    MaybeLocal<Function> ExpressionCache::Get(Local<Context> context, Local<String> source, vector<Local<String>>& params)
+    {
+        Isolate* isolate = context->GetIsolate();
+
+        // the key holds the parameter names, then the source.
+        string key;
+        for(size_t i = 0; i < params.size(); i++)
+        {
+            String::Utf8Value name(params[i]);
+            key.append(*name ? *name : "");
+            key.push_back(',');
+        }
+        key.push_back('\n');
+
+        const size_t offset = key.size();
+        String::Utf8Value text(source);
+        key.append(*text ? *text : "", *text ? text.length() : 0);
+
+        const uint64_t hash = Hash(key);
+        map<uint64_t, list<Entry>::iterator>::iterator found = m_index.find(hash);
+        if(found != m_index.end() && found->second->key == key)
+        {
+            m_counters.hits++;
+            m_entries.splice(m_entries.begin(), m_entries, found->second);
+            return Local<Function>::New(isolate, found->second->function);
+        }
+
+        m_counters.misses++;
+        Local<Function> function;
+        if(!Compile(context, hash, key, key.substr(offset), params).ToLocal(&function))
+        {
+            return MaybeLocal<Function>();
+        }
+
+        if(found != m_index.end())
+        {
+            // two sources with the same hash, the newer one takes the slot.
+            m_entries.erase(found->second);
+            m_index.erase(found);
+        }
+        else if(m_entries.size() >= kCapacity)
+        {
+            m_index.erase(m_entries.back().hash);
+            m_entries.pop_back();
+            m_counters.evictions++;
+        }
+
+        m_entries.emplace_front();
+        m_entries.front().hash = hash;
+        m_entries.front().key.swap(key);
+        m_entries.front().function.Reset(isolate, function);
+        m_index[hash] = m_entries.begin();
+
+        return function;
+    }
+
+    void ExpressionCache::Clear()
+    {
+        for(list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            it->function.Reset();
+        }
+        m_entries.clear();
+        m_index.clear();
+    }
+
+    MaybeLocal<Function> ExpressionCache::Compile(Local<Context> context, uint64_t hash, string const& key, string const& source, vector<Local<String>>& params)
+    {
+        Local<Function> function;
+        bool expression = true;
+        bool rejected = false;
+
+        {
+            // failed attempts are silent, the last one reports the syntax error.
+            TryCatch try_catch(context->GetIsolate());
+
+            vector<uint8_t> code;
+            systhread_mutex_lock(s_mutex);
+            map<uint64_t, Code>::iterator cached = s_code.find(hash);
+            if(cached != s_code.end() && cached->second.key == key)
+            {
+                code = cached->second.data;
+                expression = cached->second.expression;
+            }
+            systhread_mutex_unlock(s_mutex);
+
+            if(!code.empty())
+            {
+                ScriptCompiler::CachedData* data = new ScriptCompiler::CachedData(&code[0], (int)code.size());
+                if(CompileAs(context, source, expression, params, data, ScriptCompiler::kConsumeCodeCache, rejected).ToLocal(&function) && !rejected)
+                {
+                    m_counters.code_hits++;
+                    return function;
+                }
+
+                // V8 compiles the source itself when it refuses a code cache.
+                m_counters.code_rejected += rejected;
+            }
+
+            // the source must parse as a body on its own first, otherwise "a); b = (c"
+            // would close the parenthesis of the return and pass for an expression.
+            Local<Function> body;
+            if(function.IsEmpty() && CompileAs(context, source, false, params, nullptr, ScriptCompiler::kEagerCompile, rejected).ToLocal(&body))
+            {
+                expression = CompileAs(context, source, true, params, nullptr, ScriptCompiler::kEagerCompile, rejected).ToLocal(&function);
+                if(!expression)
+                {
+                    function = body;
+                }
+            }
+        }
+
+        if(function.IsEmpty())
+        {
+            expression = false;
+            if(!CompileAs(context, source, false, params, nullptr, ScriptCompiler::kEagerCompile, rejected).ToLocal(&function))
+            {
+                return MaybeLocal<Function>();
+            }
+        }
+
+        StoreCode(hash, key, expression, function);
+        return function;
+    }
+
+    MaybeLocal<Function> ExpressionCache::CompileAs(Local<Context> context, string const& source, bool expression, vector<Local<String>>& params,
+                                                    ScriptCompiler::CachedData* code, ScriptCompiler::CompileOptions options, bool& rejected)
+    {
+        Isolate* isolate = context->GetIsolate();
+
+        // the line breaks keep a trailing line comment out of the parenthesis.
+        const string text = expression ? "return (\n" + source + "\n);" : source;
+
+        Local<String> code_source;
+        if(!String::NewFromUtf8(isolate, text.c_str(), NewStringType::kNormal, (int)text.size()).ToLocal(&code_source))
+        {
+            delete code;
+            return MaybeLocal<Function>();
+        }
+
+        // the source takes over the code cache.
+        ScriptOrigin origin(String::NewFromUtf8(isolate, "compile"));
+        ScriptCompiler::Source compiled(code_source, origin, code);
+        MaybeLocal<Function> function = ScriptCompiler::CompileFunctionInContext(context, &compiled, params.size(), params.empty() ? nullptr : &params[0],
+                                                                                 0, nullptr, options);
+
+        rejected = code && compiled.GetCachedData()->rejected;
+        return function;
+    }
+
+    void ExpressionCache::StoreCode(uint64_t hash, string const& key, bool expression, Local<Function> function)
+    {
+        ScriptCompiler::CachedData* data = ScriptCompiler::CreateCodeCacheForFunction(function);
+        if(!data)
+        {
+            return;
+        }
+
+        systhread_mutex_lock(s_mutex);
+
+        map<uint64_t, Code>::iterator it = s_code.find(hash);
+        if(it == s_code.end())
+        {
+            if(s_code.size() >= kMaxCodeCaches)
+            {
+                s_code.erase(s_code_order.front());
+                s_code_order.pop_front();
+            }
+
+            s_code_order.push_back(hash);
+            it = s_code.insert(make_pair(hash, Code())).first;
+        }
+
+        it->second.key = key;
+        it->second.expression = expression;
+        it->second.data.assign(data->data, data->data + data->length);
+
+        systhread_mutex_unlock(s_mutex);
+
+        delete data;
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_COMPILE_H_
+#define _MAX_V8_COMPILE_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <stdint.h>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+
+    //! The functions returned by compile(source) in one isolate, least recently used dropped first.
+    //! @details A source is compiled as an expression if it is one, as a function body
+    //! otherwise. Entries are found by a hash of the parameter names and the source.
+    //! The code cache of every compiled source is also kept process-wide, so other
+    //! isolates (the next load of a script, other instances) skip parsing and compiling.
+    //! An instance is only used by the thread holding the isolate Locker.
+    //! Needs V8 6.8: CreateCodeCacheForFunction took the source in earlier versions.
+    class ExpressionCache
+    {
+    public:
+
+        enum { kCapacity = 256, kMaxCodeCaches = 1024 };
+
+        struct Counters
+        {
+            int64_t     hits;
+            int64_t     misses;
+            int64_t     evictions;
+            int64_t     code_hits;      // misses compiled from a code cache
+            int64_t     code_rejected;  // code caches V8 refused, the source was compiled again
+        };
+
+        //! Creates the process-wide code cache.
+        static void Init();
+        static void Release();
+
+        ExpressionCache();
+        ~ExpressionCache();
+
+        //! Returns the function compiled from source taking the given parameters.
+        //! @details On failure the handle is empty and an exception is pending.
+        MaybeLocal<Function> Get(Local<Context> context, Local<String> source, vector<Local<String>>& params);
+
+        //! Drops the functions, the isolate they belong to must be locked.
+        void Clear();
+
+        Counters const& GetCounters() const     {return m_counters;}
+        size_t Size() const                     {return m_entries.size();}
+
+        //! Number of code caches kept for the whole process.
+        static size_t CodeCaches();
+
+    private:
+
+        struct Entry
+        {
+            uint64_t            hash;
+            string              key;
+            Global<Function>    function;
+        };
+
+        struct Code
+        {
+            string              key;
+            bool                expression;
+            vector<uint8_t>     data;
+        };
+
+        static uint64_t Hash(string const& key);
+
+        //! Compiles a source on a miss, consuming or producing its code cache.
+        MaybeLocal<Function> Compile(Local<Context> context, uint64_t hash, string const& key, string const& source, vector<Local<String>>& params);
+
+        //! Compiles source, as the returned expression if expression is true.
+        static MaybeLocal<Function> CompileAs(Local<Context> context, string const& source, bool expression, vector<Local<String>>& params,
+                                              ScriptCompiler::CachedData* code, ScriptCompiler::CompileOptions options, bool& rejected);
+
+        static void StoreCode(uint64_t hash, string const& key, bool expression, Local<Function> function);
+
+        list<Entry>                             m_entries;  // most recently used first
+        map<uint64_t, list<Entry>::iterator>    m_index;
+        Counters                                m_counters;
+
+        static map<uint64_t, Code>  s_code;
+        static deque<uint64_t>      s_code_order;
+        static t_systhread_mutex    s_mutex;
+    };
+}
+
+#endif // _MAX_V8_COMPILE_H_
@@ -0,0 +1,168 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Console.h"
+#include "MaxV8Latency.h"
+
+namespace cicm
+{
+    Console::Console(t_object* owner) :
+    m_owner(owner),
+    m_qelem(qelem_new(this, (method)Run)),
+    m_clock(clock_new(this, (method)Tick)),
+    m_mutex(nullptr),
+    m_dropped(0),
+    m_rate(0),
+    m_last_kind(kNone),
+    m_repeats(0),
+    m_limited(0),
+    m_tokens(0.),
+    m_refilled(LatencyNow()),
+    m_reported(0.)
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+
+    Console::~Console()
+    {
+        clock_unset(m_clock);
+        freeobject((t_object*)m_clock);
+        qelem_free(m_qelem);
+        systhread_mutex_free(m_mutex);
+    }
+
+    void Console::Append(Kind kind, string& text)
+    {
+        systhread_mutex_lock(m_mutex);
+
+        if(!m_pending.empty() && m_pending.back().kind == kind && m_pending.back().text == text)
+        {
+            m_pending.back().repeats++;
+        }
+        else if(m_pending.size() < kMaxPending)
+        {
+            m_pending.push_back(Line());
+            m_pending.back().kind = kind;
+            m_pending.back().repeats = 0;
+            m_pending.back().text.swap(text);
+        }
+        else
+        {
+            // the main thread is not keeping up, don't let the backlog grow.
+            m_dropped++;
+        }
+
+        systhread_mutex_unlock(m_mutex);
+
+        qelem_set(m_qelem);
+    }
+
+    void Console::SetRate(long rate)
+    {
+        m_rate = rate > 0 ? rate : 0;
+        m_tokens = (double)m_rate;
+    }
+
+    void Console::Run(Console* console)
+    {
+        console->Flush();
+    }
+
+    void Console::Tick(Console* console)
+    {
+        qelem_set(console->m_qelem);
+    }
+
+    void Console::Flush(bool final)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_flushing.swap(m_pending);
+        m_limited += m_dropped;
+        m_dropped = 0;
+        systhread_mutex_unlock(m_mutex);
+
+        // the token bucket holds up to one second of lines.
+        const double now = LatencyNow();
+        if(m_rate)
+        {
+            m_tokens += (now - m_refilled) * 1e-6 * (double)m_rate;
+            m_tokens = m_tokens > (double)m_rate ? (double)m_rate : m_tokens;
+        }
+        m_refilled = now;
+
+        for(vector<Line>::iterator line = m_flushing.begin(); line != m_flushing.end(); ++line)
+        {
+            if(line->kind == m_last_kind && line->text == m_last_text)
+            {
+                m_repeats += 1 + line->repeats;
+                continue;
+            }
+
+            // errors always get through and don't use up the budget of post().
+            const bool limited = m_rate && line->kind != kError && !final;
+            if(limited && m_tokens < 1.)
+            {
+                m_limited += 1 + line->repeats;
+                continue;
+            }
+
+            // a new line closes the repeats of the previous one.
+            Report(now, true);
+            Print(line->kind, line->text.c_str());
+            if(limited)
+            {
+                m_tokens -= 1.;
+            }
+            m_last_kind = line->kind;
+            m_last_text.swap(line->text);
+            m_repeats = line->repeats;
+        }
+
+        // keep the line storage for the next batch.
+        m_flushing.clear();
+
+        // nothing will be posted after the final flush, report what was counted now.
+        Report(now, final);
+        if(!final && (m_repeats || m_limited))
+        {
+            clock_fdelay(m_clock, kReportInterval - (now - m_reported) * 1e-3);
+        }
+    }
+
+    void Console::Print(Kind kind, const char* text)
+    {
+        if(kind == kError)
+        {
+            object_error(m_owner, "%s", text);
+        }
+        else
+        {
+            object_post(m_owner, "%s", text);
+        }
+    }
+
+    void Console::Report(double now, bool force)
+    {
+        if(!force && now - m_reported < kReportInterval * 1e3)
+        {
+            return;
+        }
+
+        if(m_repeats)
+        {
+            object_post(m_owner, "message repeated %ld times", m_repeats);
+            m_repeats = 0;
+            m_reported = now;
+        }
+
+        if(m_limited)
+        {
+            object_post(m_owner, "%ld console messages dropped (rate limit)", m_limited);
+            m_limited = 0;
+            m_reported = now;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_CONSOLE_H_
+#define _MAX_V8_CONSOLE_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <string>
+#include <vector>
+
+namespace cicm
+{
+    using namespace std;
+
+    //! The console output of one instance.
+    //! @details post() and error() append lines from whichever thread runs the script,
+    //! a low priority qelem posts them to the Max console in batches. Consecutive
+    //! identical lines are collapsed and reported as repeats at most once per second,
+    //! post() lines over the rate limit are dropped and counted, errors are never limited.
+    class Console
+    {
+    public:
+        enum Kind { kPost = 0, kError = 1, kNone = 2 };
+        enum { kMaxPending = 1024, kReportInterval = 1000 };
+
+        explicit Console(t_object* owner);
+        ~Console();
+
+        //! Queues a line, takes the content of text.
+        void Append(Kind kind, string& text);
+
+        //! Sets the maximum number of lines posted per second, 0 for no limit.
+        void SetRate(long rate);
+
+        //! Posts the waiting lines, must be called on the main thread.
+        //! @details The final flush ignores the rate limit and reports the pending counts.
+        void Flush(bool final = false);
+
+    private:
+        struct Line
+        {
+            Kind        kind;
+            long        repeats;
+            string      text;
+        };
+
+        static void Run(Console* console);
+        static void Tick(Console* console);
+
+        void Print(Kind kind, const char* text);
+
+        //! Reports the repeats and drops counted so far, once per interval unless forced.
+        void Report(double now, bool force);
+
+        t_object*           m_owner;
+        void*               m_qelem;
+        void*               m_clock;
+        t_systhread_mutex   m_mutex;
+        vector<Line>        m_pending;
+        vector<Line>        m_flushing;
+        long                m_dropped;
+        long                m_rate;
+
+        // main thread only
+        Kind                m_last_kind;
+        string              m_last_text;
+        long                m_repeats;
+        long                m_limited;
+        double              m_tokens;
+        double              m_refilled;
+        double              m_reported;
+    };
+}
+
+#endif // _MAX_V8_CONSOLE_H_
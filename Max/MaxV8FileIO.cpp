@@ -0,0 +1,157 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8FileIO.h"
+#include "MaxV8Allocator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace cicm
+{
+    //============================================================================
+    // FileIO
+    //============================================================================
+    
+    static void Fail(FileRequest* request, const char* what)
+    {
+        request->error = string(what) + " " + request->path + ": " + strerror(errno);
+    }
+    
+    void FileIO::Run(FileRequest* request)
+    {
+        request->data = nullptr;
+        request->length = 0;
+        
+        if(request->kind == FileRequest::kWrite)
+        {
+            const int fd = open(request->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0)
+            {
+                Fail(request, "can't create");
+                return;
+            }
+            
+            const char* p = request->input.empty() ? nullptr : &request->input[0];
+            size_t left = request->input.size();
+            while(left)
+            {
+                const ssize_t written = write(fd, p, left);
+                if(written > 0)
+                {
+                    p += written;
+                    left -= (size_t)written;
+                }
+                else if(written == 0 || errno != EINTR)
+                {
+                    Fail(request, "can't write");
+                    break;
+                }
+            }
+            
+            close(fd);
+            request->length = request->input.size() - left;
+            vector<char>().swap(request->input);
+            return;
+        }
+        
+        const int fd = open(request->path, O_RDONLY);
+        struct stat info;
+        if(fd < 0 || fstat(fd, &info) != 0)
+        {
+            Fail(request, "can't open");
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+            return;
+        }
+        
+        const size_t size = (size_t)info.st_size;
+        if(!size)
+        {
+            close(fd);
+            return;
+        }
+        
+        // the bytes are read rather than mapped, a mapped file truncated by another
+        // process would fault when the script touches the ArrayBuffer.
+        void* data = BufferPool::Allocate(size, false);
+        size_t done = 0;
+        while(data && done < size)
+        {
+            const ssize_t n = pread(fd, (char*)data + done, size - done, (off_t)done);
+            if(n > 0)
+            {
+                done += (size_t)n;
+            }
+            else if(n == 0 || errno != EINTR)
+            {
+                // a file shrinking while it is read fails as well.
+                Fail(request, "can't read");
+                BufferPool::Free(data, size);
+                data = nullptr;
+            }
+        }
+        
+        close(fd);
+        
+        if(!data && request->error.empty())
+        {
+            request->error = string("not enough memory to read ") + request->path;
+        }
+        else if(data)
+        {
+            request->data = data;
+            request->length = size;
+        }
+    }
+    
+    void FileIO::Discard(FileRequest* request)
+    {
+        if(request->kind == FileRequest::kRead && request->data)
+        {
+            BufferPool::Free(request->data, request->length);
+            request->data = nullptr;
+        }
+    }
+    
+    //============================================================================
+    // FileCompletions
+    //============================================================================
+    
+    FileCompletions::FileCompletions(void* owner, method handler) :
+    m_mutex(nullptr),
+    m_qelem(qelem_new(owner, handler))
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+    
+    FileCompletions::~FileCompletions()
+    {
+        qelem_free(m_qelem);
+        systhread_mutex_free(m_mutex);
+    }
+    
+    void FileCompletions::Post(FileRequest* request)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_done.push_back(request);
+        systhread_mutex_unlock(m_mutex);
+        
+        qelem_set(m_qelem);
+    }
+    
+    void FileCompletions::Take(vector<FileRequest*>& done)
+    {
+        systhread_mutex_lock(m_mutex);
+        done.swap(m_done);
+        systhread_mutex_unlock(m_mutex);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_FILE_IO_H_
+#define _MAX_V8_FILE_IO_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <string>
+#include <vector>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+    
+    //! A readFile or writeFile call of a script, run on the thread pool.
+    struct FileRequest
+    {
+        enum Kind { kRead, kWrite };
+        
+        Kind                        kind;
+        void*                       owner;
+        char                        path[MAX_PATH_CHARS];
+        Isolate*                    isolate;
+        Global<Promise::Resolver>   resolver;
+        
+        //! bytes to write
+        vector<char>                input;
+        
+        //! bytes read, in a buffer the ArrayBuffer allocator can free
+        void*                       data;
+        size_t                      length;
+        
+        //! set when the request failed
+        string                      error;
+    };
+    
+    //! Blocking file operations of the readFile and writeFile requests.
+    class FileIO
+    {
+    public:
+        
+        //! Runs a request on the calling thread.
+        //! @details Files are read into a BufferPool buffer, large ones get the anonymous
+        //! mapping the pool makes for large buffers.
+        static void Run(FileRequest* request);
+        
+        //! Frees the bytes of a read request that no ArrayBuffer took.
+        static void Discard(FileRequest* request);
+    };
+    
+    //! The finished file requests of an instance, handed back to the main thread by a qelem.
+    class FileCompletions
+    {
+    public:
+        FileCompletions(void* owner, method handler);
+        ~FileCompletions();
+        
+        void Post(FileRequest* request);
+        
+        //! Moves the finished requests into done.
+        void Take(vector<FileRequest*>& done);
+        
+    private:
+        t_systhread_mutex       m_mutex;
+        vector<FileRequest*>    m_done;
+        void*                   m_qelem;
+    };
+}
+
+#endif // _MAX_V8_FILE_IO_H_
@@ -0,0 +1,157 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8JitDiag.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace cicm
+{
+    JitDiagnostics::JitDiagnostics() : m_mutex(nullptr)
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+    
+    JitDiagnostics::~JitDiagnostics()
+    {
+        systhread_mutex_free(m_mutex);
+    }
+    
+    void JitDiagnostics::Attach(Isolate* isolate)
+    {
+        isolate->SetData(kDataSlot, this);
+        isolate->SetJitCodeEventHandler(kJitCodeEventDefault, HandleEvent);
+    }
+    
+    void JitDiagnostics::Detach(Isolate* isolate)
+    {
+        isolate->SetJitCodeEventHandler(kJitCodeEventDefault, nullptr);
+        isolate->SetData(kDataSlot, nullptr);
+    }
+    
+    void JitDiagnostics::Reset()
+    {
+        systhread_mutex_lock(m_mutex);
+        m_functions.clear();
+        systhread_mutex_unlock(m_mutex);
+    }
+    
+    void JitDiagnostics::HandleEvent(const JitCodeEvent* event)
+    {
+        if(event->type != JitCodeEvent::CODE_ADDED)
+        {
+            return;
+        }
+        
+        // code is installed by the thread running the isolate, which has entered it.
+        Isolate* isolate = Isolate::GetCurrent();
+        JitDiagnostics* diagnostics = isolate ? static_cast<JitDiagnostics*>(isolate->GetData(kDataSlot)) : nullptr;
+        if(diagnostics)
+        {
+            diagnostics->Add(event->name.str, event->name.len, event->code_len);
+        }
+    }
+    
+    void JitDiagnostics::Add(const char* name, size_t length, size_t code_size)
+    {
+        // names look like "LazyCompile:*handler /path/script.js:12:4", where '*' marks
+        // optimized code and '~' code that is not, builtins and stubs have no marker.
+        const char* colon = (const char*)memchr(name, ':', length);
+        if(!colon || colon + 1 >= name + length)
+        {
+            return;
+        }
+        
+        const char marker = colon[1];
+        if(marker != '*' && marker != '~')
+        {
+            return;
+        }
+        
+        const char* function = colon + 2;
+        const string key(function, name + length - function);
+        
+        // functions of the embedding itself have no script position.
+        if(key.find(':') == string::npos)
+        {
+            return;
+        }
+        
+        systhread_mutex_lock(m_mutex);
+        FunctionStats& stats = m_functions[key];
+        if(marker == '*')
+        {
+            stats.optimized++;
+            stats.optimized_size = code_size;
+        }
+        else
+        {
+            stats.bytecode++;
+        }
+        systhread_mutex_unlock(m_mutex);
+    }
+    
+    static bool MoreOptimized(pair<string, long> const& a, pair<string, long> const& b)
+    {
+        return a.second > b.second;
+    }
+    
+    void JitDiagnostics::Post(t_object* x, const char* filename)
+    {
+        vector<pair<string, long> > order;
+        map<string, FunctionStats> functions;
+        
+        systhread_mutex_lock(m_mutex);
+        functions = m_functions;
+        systhread_mutex_unlock(m_mutex);
+        
+        for(map<string, FunctionStats>::iterator it = functions.begin(); it != functions.end(); ++it)
+        {
+            order.push_back(make_pair(it->first, it->second.optimized));
+        }
+        
+        if(order.empty())
+        {
+            object_post(x, "jitdiag: no code compiled for %s yet", filename);
+            return;
+        }
+        
+        stable_sort(order.begin(), order.end(), MoreOptimized);
+        
+        long unstable = 0;
+        for(vector<pair<string, long> >::iterator it = order.begin(); it != order.end(); ++it)
+        {
+            FunctionStats const& stats = functions[it->first];
+            const char* name = it->first.c_str();
+            if(name[0] == ' ')
+            {
+                name++;
+            }
+            
+            if(stats.optimized > 1)
+            {
+                unstable++;
+                object_warn(x, "jitdiag: %s optimized %ld times (%lu bytes), deoptimized at least %ld times: check for changing argument types",
+                            name, stats.optimized, (unsigned long)stats.optimized_size, stats.optimized - 1);
+            }
+            else if(stats.optimized == 1)
+            {
+                object_post(x, "jitdiag: %s optimized (%lu bytes)", name, (unsigned long)stats.optimized_size);
+            }
+            else
+            {
+                object_post(x, "jitdiag: %s interpreted, compiled %ld times", name, stats.bytecode);
+            }
+        }
+        
+        if(unstable)
+        {
+            object_post(x, "jitdiag: inline cache states are only logged by V8, add --trace-ic to the flags of v8js-config.json to see them");
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_JIT_DIAG_H_
+#define _MAX_V8_JIT_DIAG_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <map>
+#include <string>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+    
+    //! Counts how often V8 compiles, optimizes and re-optimizes each function of a script.
+    //! @details The counts come from the JIT code events of the isolates it is attached to.
+    //! A function optimized again and again is deoptimized in between, most often
+    //! because the types it sees keep changing.
+    class JitDiagnostics
+    {
+    public:
+        
+        //! Isolate data slot pointing to the attached diagnostics.
+        enum { kDataSlot = 0 };
+        
+        JitDiagnostics();
+        ~JitDiagnostics();
+        
+        //! Starts receiving the code events of an isolate.
+        void Attach(Isolate* isolate);
+        
+        //! Stops receiving the code events of an isolate.
+        static void Detach(Isolate* isolate);
+        
+        void Reset();
+        
+        //! Posts the compiled functions, the most re-optimized first.
+        void Post(t_object* x, const char* filename);
+        
+    private:
+        
+        struct FunctionStats
+        {
+            long    bytecode;
+            long    optimized;
+            size_t  optimized_size;
+        };
+        
+        static void HandleEvent(const JitCodeEvent* event);
+        void Add(const char* name, size_t length, size_t code_size);
+        
+        map<string, FunctionStats>  m_functions;
+        t_systhread_mutex           m_mutex;
+    };
+}
+
+#endif // _MAX_V8_JIT_DIAG_H_
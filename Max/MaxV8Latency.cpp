@@ -0,0 +1,272 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Latency.h"
+
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace cicm
+{
+    double LatencyNow()
+    {
+#ifdef __APPLE__
+        static double ticks_to_us = 0.;
+        if(ticks_to_us == 0.)
+        {
+            mach_timebase_info_data_t timebase;
+            mach_timebase_info(&timebase);
+            ticks_to_us = (double)timebase.numer / (double)timebase.denom / 1000.;
+        }
+        return (double)mach_absolute_time() * ticks_to_us;
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (double)now.tv_sec * 1000000. + (double)now.tv_nsec / 1000.;
+#endif
+    }
+    
+    //============================================================================
+    // LatencyHistogram
+    //============================================================================
+    
+    LatencyHistogram::LatencyHistogram()
+    {
+        Reset();
+    }
+    
+    void LatencyHistogram::Reset()
+    {
+        memset(m_buckets, 0, sizeof(m_buckets));
+        m_count = 0;
+        m_sum = 0.;
+        m_max = 0.;
+    }
+    
+    void LatencyHistogram::Add(double us)
+    {
+        if(us < 0.)
+        {
+            us = 0.;
+        }
+        
+        // bucket i holds [2^(i-1), 2^i) microseconds, bucket 0 everything below 1.
+        long bucket = 0;
+        for(uint64_t v = (uint64_t)us; v && bucket < kNumBuckets - 1; v >>= 1)
+        {
+            bucket++;
+        }
+        
+        m_buckets[bucket]++;
+        m_count++;
+        m_sum += us;
+        if(us > m_max)
+        {
+            m_max = us;
+        }
+    }
+    
+    double LatencyHistogram::Percentile(double fraction) const
+    {
+        const uint64_t rank = (uint64_t)(fraction * (double)m_count);
+        uint64_t seen = 0;
+        for(long i = 0; i < kNumBuckets; i++)
+        {
+            seen += m_buckets[i];
+            if(seen > rank)
+            {
+                return (double)((uint64_t)1 << i);
+            }
+        }
+        return m_max;
+    }
+    
+    void LatencyHistogram::Post(t_object* x, const char* label) const
+    {
+        if(!m_count)
+        {
+            object_post(x, "%s: no samples", label);
+            return;
+        }
+        
+        object_post(x, "%s: %llu samples, mean %.1f us, p50 < %.0f us, p99 < %.0f us, max %.1f us",
+                    label, (unsigned long long)m_count, m_sum / (double)m_count,
+                    Percentile(0.5), Percentile(0.99), m_max);
+    }
+    
+    //============================================================================
+    // StampQueue
+    //============================================================================
+    
+    StampQueue::StampQueue() : m_mutex(nullptr)
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+    
+    StampQueue::~StampQueue()
+    {
+        systhread_mutex_free(m_mutex);
+    }
+    
+    void StampQueue::Push(double stamp)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_stamps.push_back(stamp);
+        systhread_mutex_unlock(m_mutex);
+    }
+    
+    double StampQueue::Pop()
+    {
+        double stamp = 0.;
+        systhread_mutex_lock(m_mutex);
+        if(!m_stamps.empty())
+        {
+            stamp = m_stamps.front();
+            m_stamps.pop_front();
+        }
+        systhread_mutex_unlock(m_mutex);
+        return stamp;
+    }
+    
+    //============================================================================
+    // Tracer
+    //============================================================================
+    
+    vector<Tracer::Event>   Tracer::s_events;
+    size_t                  Tracer::s_dropped = 0;
+    map<long, string>       Tracer::s_tracks;
+    string                  Tracer::s_path;
+    t_systhread_mutex       Tracer::s_mutex = nullptr;
+    volatile bool           Tracer::s_running = false;
+    
+    void Tracer::Init()
+    {
+        systhread_mutex_new(&s_mutex, 0);
+    }
+    
+    void Tracer::Start(const char* path)
+    {
+        systhread_mutex_lock(s_mutex);
+        s_events.clear();
+        s_dropped = 0;
+        s_path = path;
+        s_running = true;
+        systhread_mutex_unlock(s_mutex);
+    }
+    
+    bool Tracer::Stop(size_t& dropped)
+    {
+        systhread_mutex_lock(s_mutex);
+        s_running = false;
+        dropped = s_dropped;
+        
+        FILE* file = fopen(s_path.c_str(), "w");
+        if(file)
+        {
+            fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+            
+            bool first = true;
+            for(map<long, string>::iterator it = s_tracks.begin(); it != s_tracks.end(); ++it)
+            {
+                fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%ld,\"args\":{\"name\":",
+                        first ? "" : ",\n", it->first);
+                WriteString(file, it->second.c_str());
+                fprintf(file, "}}");
+                first = false;
+            }
+            
+            for(vector<Event>::iterator it = s_events.begin(); it != s_events.end(); ++it)
+            {
+                // selectors and file names may hold quotes or backslashes.
+                fprintf(file, "%s{\"ph\":\"%c\",\"name\":", first ? "" : ",\n", it->phase);
+                WriteString(file, it->name->s_name);
+                fprintf(file, ",\"cat\":\"%s\",\"pid\":1,\"tid\":%ld,\"ts\":%.3f", it->category, it->track, it->time);
+                first = false;
+                
+                if(it->phase == 'X')
+                {
+                    fprintf(file, ",\"dur\":%.3f}", it->duration);
+                }
+                else
+                {
+                    fprintf(file, ",\"s\":\"t\",\"args\":{\"index\":%ld}}", it->arg);
+                }
+            }
+            
+            fprintf(file, "\n]}\n");
+            fclose(file);
+        }
+        
+        // give the memory of a long trace back.
+        vector<Event>().swap(s_events);
+        systhread_mutex_unlock(s_mutex);
+        
+        return file != nullptr;
+    }
+    
+    void Tracer::WriteString(FILE* file, const char* text)
+    {
+        fputc('"', file);
+        for(const unsigned char* p = (const unsigned char*)text; *p; p++)
+        {
+            if(*p == '"' || *p == '\\')
+            {
+                fputc('\\', file);
+                fputc(*p, file);
+            }
+            else if(*p < 0x20)
+            {
+                fprintf(file, "\\u%04x", *p);
+            }
+            else
+            {
+                fputc(*p, file);
+            }
+        }
+        fputc('"', file);
+    }
+    
+    void Tracer::NameTrack(long track, const char* name)
+    {
+        systhread_mutex_lock(s_mutex);
+        s_tracks[track] = name;
+        systhread_mutex_unlock(s_mutex);
+    }
+    
+    void Tracer::Span(t_symbol* name, const char* category, long track, double start, double duration)
+    {
+        Event event = {name, category, 'X', track, start, duration, 0};
+        Record(event);
+    }
+    
+    void Tracer::Instant(t_symbol* name, const char* category, long track, double time, long arg)
+    {
+        Event event = {name, category, 'i', track, time, 0., arg};
+        Record(event);
+    }
+    
+    void Tracer::Record(Event const& event)
+    {
+        systhread_mutex_lock(s_mutex);
+        if(s_running)
+        {
+            if(s_events.size() < kMaxEvents)
+            {
+                s_events.push_back(event);
+            }
+            else
+            {
+                s_dropped++;
+            }
+        }
+        systhread_mutex_unlock(s_mutex);
+    }
+}
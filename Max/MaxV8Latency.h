@@ -0,0 +1,134 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_LATENCY_H_
+#define _MAX_V8_LATENCY_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cicm
+{
+    using namespace std;
+    
+    //! Returns a monotonic time in microseconds.
+    double LatencyNow();
+    
+    //! A histogram of durations with one bucket per power of two microseconds.
+    class LatencyHistogram
+    {
+    public:
+        enum { kNumBuckets = 32 };
+        
+        LatencyHistogram();
+        
+        void Add(double us);
+        void Reset();
+        
+        //! Posts count, mean, median, 99th percentile and maximum.
+        void Post(t_object* x, const char* label) const;
+        
+    private:
+        //! Returns the upper bound of the bucket holding the given fraction of the samples.
+        double Percentile(double fraction) const;
+        
+        uint64_t    m_buckets[kNumBuckets];
+        uint64_t    m_count;
+        double      m_sum;
+        double      m_max;
+    };
+    
+    //! The latency histograms of one instance.
+    //! @details Samples are added by the thread running the script, which the isolate
+    //! Locker serializes.
+    struct LatencyStats
+    {
+        LatencyHistogram    wait;       // from the inlet to the start of the handler
+        LatencyHistogram    execution;  // handler run time
+        LatencyHistogram    response;   // from the inlet to each outlet call
+    };
+    
+    //! Timestamps of messages deferred to the main thread, in order.
+    class StampQueue
+    {
+    public:
+        StampQueue();
+        ~StampQueue();
+        
+        void Push(double stamp);
+        double Pop();
+        
+    private:
+        t_systhread_mutex   m_mutex;
+        deque<double>       m_stamps;
+    };
+    
+    //! Records events of every instance for chrome://tracing.
+    //! @details At most kMaxEvents are kept, later events are counted and dropped.
+    class Tracer
+    {
+    public:
+        
+        enum { kMaxEvents = 1 << 20 };
+        
+        static void Init();
+        
+        //! Starts recording events to be written to path, events recorded before are discarded.
+        static void Start(const char* path);
+        
+        //! Stops recording and writes the Chrome trace-event file, returns false if it can't be written.
+        //! @details dropped receives the number of events that didn't fit.
+        static bool Stop(size_t& dropped);
+        
+        static bool Running() {return s_running;}
+        
+        //! Names the track of an instance.
+        static void NameTrack(long track, const char* name);
+        
+        //! Records a span, times in microseconds.
+        static void Span(t_symbol* name, const char* category, long track, double start, double duration);
+        
+        //! Records an instant event.
+        static void Instant(t_symbol* name, const char* category, long track, double time, long arg);
+        
+    private:
+        
+        struct Event
+        {
+            t_symbol*   name;
+            const char* category;
+            char        phase;
+            long        track;
+            double      time;
+            double      duration;
+            long        arg;
+        };
+        
+        static void Record(Event const& event);
+        
+        //! Writes text as a JSON string.
+        static void WriteString(FILE* file, const char* text);
+        
+        static vector<Event>        s_events;
+        static size_t               s_dropped;
+        static map<long, string>    s_tracks;
+        static string               s_path;
+        static t_systhread_mutex    s_mutex;
+        static volatile bool        s_running;
+    };
+}
+
+#endif // _MAX_V8_LATENCY_H_
@@ -0,0 +1,94 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Message.h"
+
+namespace cicm
+{
+    MessageQueue::MessageQueue() : m_mutex(nullptr)
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+
+    MessageQueue::~MessageQueue()
+    {
+        Clear();
+
+        for(vector<Message*>::iterator it = m_free.begin(); it != m_free.end(); ++it)
+        {
+            delete *it;
+        }
+
+        systhread_mutex_free(m_mutex);
+    }
+
+    void MessageQueue::Push(t_symbol* selector, long index, long origin, long ac, t_atom* av, double stamp)
+    {
+        systhread_mutex_lock(m_mutex);
+
+        Message* msg;
+        if(!m_free.empty())
+        {
+            msg = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            msg = new Message();
+        }
+
+        msg->selector = selector;
+        msg->index = index;
+        msg->origin = origin;
+        msg->stamp = stamp;
+        msg->atoms.assign(av, av + (ac > 0 ? ac : 0));
+        m_messages.push_back(msg);
+
+        systhread_mutex_unlock(m_mutex);
+    }
+
+    bool MessageQueue::Pop(Message& out)
+    {
+        systhread_mutex_lock(m_mutex);
+
+        if(m_messages.empty())
+        {
+            systhread_mutex_unlock(m_mutex);
+            return false;
+        }
+
+        Message* msg = m_messages.front();
+        m_messages.pop_front();
+
+        out.selector = msg->selector;
+        out.index = msg->index;
+        out.origin = msg->origin;
+        out.stamp = msg->stamp;
+
+        // swap rather than copy so both buffers keep their capacity.
+        out.atoms.swap(msg->atoms);
+        m_free.push_back(msg);
+
+        systhread_mutex_unlock(m_mutex);
+        return true;
+    }
+
+    bool MessageQueue::Empty()
+    {
+        systhread_mutex_lock(m_mutex);
+        const bool empty = m_messages.empty();
+        systhread_mutex_unlock(m_mutex);
+        return empty;
+    }
+
+    void MessageQueue::Clear()
+    {
+        systhread_mutex_lock(m_mutex);
+        m_free.insert(m_free.end(), m_messages.begin(), m_messages.end());
+        m_messages.clear();
+        systhread_mutex_unlock(m_mutex);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_MESSAGE_H_
+#define _MAX_V8_MESSAGE_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <deque>
+#include <vector>
+
+namespace cicm
+{
+    using namespace std;
+
+    //! A Max message waiting to be delivered to (or sent from) a v8js instance.
+    struct Message
+    {
+        t_symbol*       selector;
+        long            index;      // inlet of an inbound message, outlet of an outbound one
+        long            origin;     // thread the message came from
+        double          stamp;      // arrival time when measuring latency, 0 otherwise
+        vector<t_atom>  atoms;
+    };
+
+    //! A thread-safe FIFO of messages.
+    //! @details Popped messages hand their atom storage back to the queue, so
+    //! once the queue has warmed up pushing and popping no longer allocates.
+    class MessageQueue
+    {
+    public:
+        MessageQueue();
+        ~MessageQueue();
+
+        //! Appends a copy of a message.
+        void Push(t_symbol* selector, long index, long origin, long ac, t_atom* av, double stamp = 0.);
+
+        //! Moves the oldest message into msg, returns false if the queue is empty.
+        bool Pop(Message& msg);
+
+        //! Returns true if no message is waiting.
+        bool Empty();
+
+        //! Drops every waiting message.
+        void Clear();
+
+    private:
+        t_systhread_mutex   m_mutex;
+        deque<Message*>     m_messages;
+        vector<Message*>    m_free;
+    };
+}
+
+#endif // _MAX_V8_MESSAGE_H_
@@ -0,0 +1,160 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Profile.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+    
+    const Profile Profiles::s_profiles[] =
+    {
+        // V8 defaults: lazy compilation and a heap sized from the physical memory.
+        {"default",     "",                                 0,  0},
+        
+        // compile everything up front so a handler never compiles on its first call,
+        // a larger young generation makes scavenges rarer.
+        {"low-latency", "--no-lazy",                        16, 0},
+        
+        // keep the optimizing tiers and give the heap room to grow before collecting.
+        {"throughput",  "",                                 32, 2048},
+        
+        // smaller code and a small heap, at the cost of more frequent collections.
+        {"low-memory",  "--optimize-for-size --lazy",       1,  128},
+        
+        {nullptr,       nullptr,                            0,  0}
+    };
+    
+    const Profile*  Profiles::s_default = s_profiles;
+    long            Profiles::s_semi_space = 0;
+    long            Profiles::s_old_space = 0;
+    
+    void Profiles::Configure()
+    {
+        char filename[MAX_PATH_CHARS];
+        short path;
+        t_fourcc type;
+        
+        strncpy_zero(filename, "v8js-config.json", MAX_PATH_CHARS);
+        if(locatefile_extended(filename, &path, &type, nullptr, 0))
+        {
+            return;
+        }
+        
+        t_dictionary* config = nullptr;
+        if(dictionary_read(filename, path, &config) != MAX_ERR_NONE || !config)
+        {
+            error("v8js: can't read %s", filename);
+            return;
+        }
+        
+        t_symbol* name = nullptr;
+        if(dictionary_getsym(config, gensym("profile"), &name) == MAX_ERR_NONE && name)
+        {
+            const Profile* profile = nullptr;
+            for(const Profile* p = s_profiles; p->name; p++)
+            {
+                if(name == gensym(p->name))
+                {
+                    profile = p;
+                }
+            }
+            
+            if(profile)
+            {
+                s_default = profile;
+            }
+            else
+            {
+                error("v8js: unknown profile %s in %s", name->s_name, filename);
+            }
+        }
+        
+        t_atom_long size;
+        if(dictionary_getlong(config, gensym("semispace"), &size) == MAX_ERR_NONE && size > 0)
+        {
+            s_semi_space = (long)size;
+        }
+        if(dictionary_getlong(config, gensym("oldspace"), &size) == MAX_ERR_NONE && size > 0)
+        {
+            s_old_space = (long)size;
+        }
+        
+        // the flags of the config file come last so they can override the profile ones.
+        string flags = s_default->flags;
+        const char* extra = nullptr;
+        if(dictionary_getstring(config, gensym("flags"), &extra) == MAX_ERR_NONE && extra)
+        {
+            flags += " ";
+            flags += extra;
+        }
+        
+        object_free(config);
+        
+        if(flags.find_first_not_of(' ') != string::npos)
+        {
+            V8::SetFlagsFromString(flags.c_str(), (int)flags.size());
+            post("v8js: profile %s, flags: %s", s_default->name, flags.c_str());
+        }
+    }
+    
+    const Profile* Profiles::Find(t_symbol* name)
+    {
+        if(!name || name == gensym("") || name == gensym("default"))
+        {
+            return s_default;
+        }
+        
+        for(const Profile* p = s_profiles; p->name; p++)
+        {
+            if(name == gensym(p->name))
+            {
+                return p;
+            }
+        }
+        
+        return nullptr;
+    }
+    
+    const char* Profiles::Names()
+    {
+        static string names;
+        if(names.empty())
+        {
+            for(const Profile* p = s_profiles; p->name; p++)
+            {
+                names += names.empty() ? "" : " ";
+                names += p->name;
+            }
+        }
+        return names.c_str();
+    }
+    
+    void Profiles::Apply(Isolate::CreateParams& params, const Profile* profile, long semi_space, long old_space)
+    {
+        // the sizes of the config file go with its profile, a profile chosen by the instance
+        // brings its own and only leaves the sizes it doesn't set to the config file.
+        const bool chosen = profile != s_default;
+        if(!semi_space)
+        {
+            semi_space = (chosen && profile->semi_space) || !s_semi_space ? profile->semi_space : s_semi_space;
+        }
+        if(!old_space)
+        {
+            old_space = (chosen && profile->old_space) || !s_old_space ? profile->old_space : s_old_space;
+        }
+        
+        if(semi_space > 0)
+        {
+            params.constraints.set_max_semi_space_size((size_t)semi_space);
+        }
+        if(old_space > 0)
+        {
+            params.constraints.set_max_old_space_size((size_t)old_space);
+        }
+    }
+}
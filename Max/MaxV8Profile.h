@@ -0,0 +1,64 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_PROFILE_H_
+#define _MAX_V8_PROFILE_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_dictionary.h"
+}
+
+#include <string>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    //! A named bundle of V8 flags and heap constraints.
+    //! @details Sizes are in megabytes, 0 keeps the V8 default.
+    struct Profile
+    {
+        const char* name;
+        const char* flags;
+        long        semi_space;
+        long        old_space;
+    };
+    
+    //! Engine profiles, read from the package config file and chosen per instance.
+    //! @details V8 flags are process-wide: they come from the profile and the flags
+    //! of the config file only. Instances can only pick their own heap constraints.
+    class Profiles
+    {
+    public:
+        
+        //! Reads v8js-config.json from the search path and sets the V8 flags.
+        //! @details Must be called before V8::Initialize.
+        static void Configure();
+        
+        //! Returns the profile with the given name or nullptr.
+        //! @details "default" is the profile selected by the config file.
+        static const Profile* Find(t_symbol* name);
+        
+        //! Sets the heap constraints of an isolate.
+        //! @details Sizes that are not 0 come first, then those set by a profile chosen by the instance,
+        //! then those of the config file, then those of the default profile.
+        static void Apply(v8::Isolate::CreateParams& params, const Profile* profile, long semi_space, long old_space);
+        
+        //! Returns the list of profile names for the profile attribute.
+        static const char* Names();
+        
+    private:
+        static const Profile    s_profiles[];
+        static const Profile*   s_default;
+        static long             s_semi_space;
+        static long             s_old_space;
+    };
+}
+
+#endif // _MAX_V8_PROFILE_H_
@@ -0,0 +1,182 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Registry.h"
+
+extern "C"
+{
+#include "jpatcher_api.h"
+}
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace cicm
+{
+    using namespace std;
+    
+    InstanceStats*      Registry::s_head = nullptr;
+    long                Registry::s_size = 0;
+    t_systhread_mutex   Registry::s_mutex = nullptr;
+    
+    void Registry::Init()
+    {
+        systhread_mutex_new(&s_mutex, 0);
+    }
+    
+    void Registry::Add(InstanceStats* stats)
+    {
+        systhread_mutex_new(&stats->mutex, 0);
+        
+        systhread_mutex_lock(s_mutex);
+        stats->prev = nullptr;
+        stats->next = s_head;
+        if(s_head)
+        {
+            s_head->prev = stats;
+        }
+        s_head = stats;
+        s_size++;
+        systhread_mutex_unlock(s_mutex);
+    }
+    
+    void Registry::Remove(InstanceStats* stats)
+    {
+        systhread_mutex_lock(s_mutex);
+        if(stats->prev)
+        {
+            stats->prev->next = stats->next;
+        }
+        else
+        {
+            s_head = stats->next;
+        }
+        if(stats->next)
+        {
+            stats->next->prev = stats->prev;
+        }
+        s_size--;
+        systhread_mutex_unlock(s_mutex);
+        
+        systhread_mutex_free(stats->mutex);
+    }
+    
+    int64_t Registry::Executed(InstanceStats* stats, double us)
+    {
+        systhread_mutex_lock(stats->mutex);
+        stats->execution_us += us;
+        const int64_t messages = ++stats->messages;
+        systhread_mutex_unlock(stats->mutex);
+        return messages;
+    }
+    
+    void Registry::Sampled(InstanceStats* stats, int64_t heap_bytes, int64_t buffer_bytes)
+    {
+        systhread_mutex_lock(stats->mutex);
+        stats->heap_bytes = heap_bytes;
+        stats->buffer_bytes = buffer_bytes;
+        systhread_mutex_unlock(stats->mutex);
+    }
+    
+    //! The counters of one instance, copied so they can be sorted while handlers keep running.
+    struct TopRow
+    {
+        t_object*   owner;
+        string      filename;
+        double      execution_us;
+        int64_t     messages;
+        int64_t     heap_bytes;
+        int64_t     buffer_bytes;
+        long        queued;
+    };
+    
+    static bool MoreExpensive(TopRow const& a, TopRow const& b)
+    {
+        return a.execution_us > b.execution_us;
+    }
+    
+    //! Returns the names of the patchers holding an object, from the top level one.
+    static string PatcherPath(t_object* x)
+    {
+        t_object* patcher = nullptr;
+        if(object_obex_lookup(x, gensym("#P"), &patcher) != MAX_ERR_NONE)
+        {
+            return "?";
+        }
+        
+        string path;
+        for(; patcher; patcher = jpatcher_get_parentpatcher(patcher))
+        {
+            t_symbol* name = jpatcher_get_name(patcher);
+            path = string(name && name->s_name[0] ? name->s_name : "(unnamed)") + (path.empty() ? "" : "/") + path;
+        }
+        return path;
+    }
+    
+    void Registry::Top(t_object* x, long count)
+    {
+        vector<TopRow> rows;
+        double total_us = 0.;
+        
+        systhread_mutex_lock(s_mutex);
+        rows.reserve(s_size);
+        for(InstanceStats* stats = s_head; stats; stats = stats->next)
+        {
+            TopRow row;
+            row.owner = stats->owner;
+            row.filename = stats->filename;
+            row.queued = (long)stats->dispatched - (long)stats->started;
+            
+            systhread_mutex_lock(stats->mutex);
+            row.execution_us = stats->execution_us;
+            row.messages = stats->messages;
+            row.heap_bytes = stats->heap_bytes;
+            row.buffer_bytes = stats->buffer_bytes;
+            systhread_mutex_unlock(stats->mutex);
+            
+            total_us += row.execution_us;
+            rows.push_back(row);
+        }
+        systhread_mutex_unlock(s_mutex);
+        
+        // instances are freed on the main thread, the owners stay valid while this runs.
+        sort(rows.begin(), rows.end(), MoreExpensive);
+        
+        object_post(x, "top: %ld v8js instances, %.1f ms in handlers", (long)rows.size(), total_us / 1000.);
+        
+        const size_t shown = count > 0 && (long)rows.size() > count ? (size_t)count : rows.size();
+        for(size_t i = 0; i < shown; i++)
+        {
+            TopRow const& row = rows[i];
+            
+            object_post(x, "%3lu. %9.1f ms %5.1f%% %9lld msgs %7.1f us/msg  heap %.1f MB  buffers %.1f MB  queue %ld  %s : %s",
+                        (unsigned long)i + 1,
+                        row.execution_us / 1000.,
+                        total_us > 0. ? 100. * row.execution_us / total_us : 0.,
+                        (long long)row.messages,
+                        row.messages ? row.execution_us / (double)row.messages : 0.,
+                        (double)row.heap_bytes / 1048576.,
+                        (double)row.buffer_bytes / 1048576.,
+                        row.queued > 0 ? row.queued : 0,
+                        PatcherPath(row.owner).c_str(),
+                        row.filename.empty() ? "(no script)" : row.filename.c_str());
+        }
+    }
+    
+    void Registry::Reset()
+    {
+        systhread_mutex_lock(s_mutex);
+        for(InstanceStats* stats = s_head; stats; stats = stats->next)
+        {
+            systhread_mutex_lock(stats->mutex);
+            stats->execution_us = 0.;
+            stats->messages = 0;
+            systhread_mutex_unlock(stats->mutex);
+        }
+        systhread_mutex_unlock(s_mutex);
+    }
+}
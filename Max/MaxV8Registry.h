@@ -0,0 +1,72 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_REGISTRY_H_
+#define _MAX_V8_REGISTRY_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_systhread.h"
+#include "ext_atomic.h"
+}
+
+#include <stdint.h>
+
+namespace cicm
+{
+    //! The cost counters of one v8js instance.
+    //! @details Handlers run on workers while the counters are read from the main thread,
+    //! the counters are written atomically or through the Registry under the instance mutex.
+    struct InstanceStats
+    {
+        t_object*           owner;
+        const char*         filename;
+        t_systhread_mutex   mutex;
+        
+        double              execution_us;   // time spent in handlers
+        int64_t             messages;       // handlers called
+        int64_t             heap_bytes;     // heap used, sampled after handlers
+        int64_t             buffer_bytes;   // ArrayBuffer memory, updated with the heap
+        t_int32_atomic      dispatched;     // messages received
+        t_int32_atomic      started;        // messages whose handler has started
+        
+        InstanceStats*      prev;
+        InstanceStats*      next;
+    };
+    
+    //! The process-wide list of live v8js instances.
+    //! @details Instances are only added and removed when boxes are created and freed.
+    class Registry
+    {
+    public:
+        
+        static void Init();
+        
+        static void Add(InstanceStats* stats);
+        static void Remove(InstanceStats* stats);
+        
+        //! Counts a handler that ran for us microseconds, returns the number of handlers called.
+        static int64_t Executed(InstanceStats* stats, double us);
+        
+        //! Records the memory sampled after a handler.
+        static void Sampled(InstanceStats* stats, int64_t heap_bytes, int64_t buffer_bytes);
+        
+        //! Posts the instances ranked by execution time, count limits the list if not 0.
+        static void Top(t_object* x, long count);
+        
+        //! Resets the counters of every instance.
+        static void Reset();
+        
+    private:
+        static InstanceStats*       s_head;
+        static long                 s_size;
+        static t_systhread_mutex    s_mutex;
+    };
+}
+
+#endif // _MAX_V8_REGISTRY_H_
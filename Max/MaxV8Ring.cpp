@@ -0,0 +1,560 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Ring.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cicm
+{
+    //============================================================================
+    // RingBuffer
+    //============================================================================
+
+    enum { kValuesField = 0, kStateField = 1, kNumFields = 2 };
+    enum { kLengthProperty = 0, kCapacityProperty = 1, kHeadProperty = 2 };
+
+    static Local<Private> PrivateKey(Isolate* isolate, const char* name)
+    {
+        return Private::ForApi(isolate, String::NewFromUtf8(isolate, name));
+    }
+
+    static void ThrowTypeError(Isolate* isolate, const char* message)
+    {
+        isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, message)));
+    }
+
+    void RingBuffer::Install(Local<Context> context)
+    {
+        Isolate* isolate = context->GetIsolate();
+
+        Local<FunctionTemplate> ring = FunctionTemplate::New(isolate, JsConstruct);
+        ring->SetClassName(String::NewFromUtf8(isolate, "RingBuffer"));
+        ring->InstanceTemplate()->SetInternalFieldCount(kNumFields);
+
+        const char* properties[] = {"length", "capacity", "head"};
+        for(int i = 0; i < 3; i++)
+        {
+            ring->InstanceTemplate()->SetAccessor(String::NewFromUtf8(isolate, properties[i]), JsGetter, nullptr,
+                                                  Integer::New(isolate, i), DEFAULT, ReadOnly);
+        }
+
+        // the signature makes V8 reject receivers that are not rings.
+        Local<Signature> signature = Signature::New(isolate, ring);
+        const struct {const char* name; FunctionCallback callback;} methods[] =
+        {
+            {"push", JsPush}, {"clear", JsClear}, {"at", JsAt},
+            {"sum", JsSum}, {"mean", JsMean}, {"min", JsMin}, {"max", JsMax},
+            {"variance", JsVariance}, {"rms", JsRms}
+        };
+        for(size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+        {
+            ring->PrototypeTemplate()->Set(String::NewFromUtf8(isolate, methods[i].name),
+                                           FunctionTemplate::New(isolate, methods[i].callback, Local<Value>(), signature));
+        }
+
+        // the private copy of the constructor can't be replaced by the script.
+        Local<Function> constructor;
+        if(ring->GetFunction(context).ToLocal(&constructor))
+        {
+            context->Global()->Set(context, String::NewFromUtf8(isolate, "RingBuffer"), constructor).FromMaybe(false);
+            context->Global()->SetPrivate(context, PrivateKey(isolate, "v8js:RingBuffer"), constructor).FromMaybe(false);
+        }
+    }
+
+    MaybeLocal<Object> RingBuffer::Window(Local<Context> context, size_t capacity)
+    {
+        Isolate* isolate = context->GetIsolate();
+        Local<Private> window_key = PrivateKey(isolate, "v8js:window");
+
+        RingState* state;
+        double* values;
+        Local<Value> window;
+        if(context->Global()->GetPrivate(context, window_key).ToLocal(&window) && window->IsObject()
+           && Open(Local<Object>::Cast(window), state, values) && state->capacity == capacity)
+        {
+            return Local<Object>::Cast(window);
+        }
+
+        Local<Value> constructor;
+        Local<Value> size = Number::New(isolate, (double)capacity);
+        Local<Object> ring;
+        if(!context->Global()->GetPrivate(context, PrivateKey(isolate, "v8js:RingBuffer")).ToLocal(&constructor)
+           || !constructor->IsFunction()
+           || !Local<Function>::Cast(constructor)->NewInstance(context, 1, &size).ToLocal(&ring))
+        {
+            return MaybeLocal<Object>();
+        }
+
+        context->Global()->SetPrivate(context, window_key, ring).FromMaybe(false);
+        return ring;
+    }
+
+    bool RingBuffer::Open(Local<Object> ring, RingState*& state, double*& values)
+    {
+        if(ring->InternalFieldCount() != kNumFields
+           || !ring->GetInternalField(kValuesField)->IsArrayBuffer() || !ring->GetInternalField(kStateField)->IsArrayBuffer())
+        {
+            return false;
+        }
+
+        Local<ArrayBuffer> value_buffer = Local<ArrayBuffer>::Cast(ring->GetInternalField(kValuesField));
+        Local<ArrayBuffer> state_buffer = Local<ArrayBuffer>::Cast(ring->GetInternalField(kStateField));
+        state = (RingState*)state_buffer->GetContents().Data();
+        values = (double*)value_buffer->GetContents().Data();
+
+        // a transferred buffer is detached and has no length anymore.
+        return value_buffer->ByteLength() == state->capacity * sizeof(double);
+    }
+
+    void RingBuffer::Push(RingState* state, double* values, const double* input, size_t n)
+    {
+        const size_t capacity = (size_t)state->capacity;
+        if(n == 0)
+        {
+            return;
+        }
+
+        if(n >= capacity)
+        {
+            memmove(values, input + n - capacity, capacity * sizeof(double));
+            state->head = 0;
+            state->count = capacity;
+            return;
+        }
+
+        // the input may be a view of the ring itself, then the first move could overwrite
+        // what the second one reads: copy it aside, it is shorter than the ring.
+        vector<double> copy;
+        if(input < values + capacity && input + n > values)
+        {
+            copy.assign(input, input + n);
+            input = copy.data();
+        }
+
+        const size_t write = (size_t)((state->head + state->count) % capacity);
+        const size_t first = n < capacity - write ? n : capacity - write;
+        memmove(values + write, input, first * sizeof(double));
+        memmove(values, input + first, (n - first) * sizeof(double));
+
+        if(state->count + n <= capacity)
+        {
+            state->count += n;
+        }
+        else
+        {
+            state->head = (write + n) % capacity;
+            state->count = capacity;
+        }
+    }
+
+    // floating point sums are not reassociated by the compiler, the vector
+    // versions keep two accumulators of two lanes each.
+
+    double RingBuffer::Sum(const double* values, size_t n)
+    {
+        size_t i = 0;
+        double sum = 0.;
+
+#if defined(__SSE2__)
+        __m128d a = _mm_setzero_pd();
+        __m128d b = _mm_setzero_pd();
+        for(; i + 4 <= n; i += 4)
+        {
+            a = _mm_add_pd(a, _mm_loadu_pd(values + i));
+            b = _mm_add_pd(b, _mm_loadu_pd(values + i + 2));
+        }
+
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(a, b));
+        sum = lanes[0] + lanes[1];
+#endif
+
+        for(; i < n; i++)
+        {
+            sum += values[i];
+        }
+        return sum;
+    }
+
+    void RingBuffer::Range(const double* values, size_t n, double& min, double& max)
+    {
+        if(n == 0)
+        {
+            min = max = NAN;
+            return;
+        }
+
+        size_t i = 0;
+        min = max = values[0];
+
+#if defined(__SSE2__)
+        if(n >= 4)
+        {
+            __m128d low = _mm_loadu_pd(values);
+            __m128d high = low;
+            for(i = 2; i + 2 <= n; i += 2)
+            {
+                const __m128d v = _mm_loadu_pd(values + i);
+                low = _mm_min_pd(low, v);
+                high = _mm_max_pd(high, v);
+            }
+
+            double lanes[2];
+            _mm_storeu_pd(lanes, low);
+            min = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+            _mm_storeu_pd(lanes, high);
+            max = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+        }
+#endif
+
+        for(; i < n; i++)
+        {
+            min = values[i] < min ? values[i] : min;
+            max = values[i] > max ? values[i] : max;
+        }
+    }
+
+    double RingBuffer::SquaredDeviations(const double* values, size_t n, double center)
+    {
+        size_t i = 0;
+        double sum = 0.;
+
+#if defined(__SSE2__)
+        const __m128d c = _mm_set1_pd(center);
+        __m128d a = _mm_setzero_pd();
+        __m128d b = _mm_setzero_pd();
+        for(; i + 4 <= n; i += 4)
+        {
+            const __m128d u = _mm_sub_pd(_mm_loadu_pd(values + i), c);
+            const __m128d v = _mm_sub_pd(_mm_loadu_pd(values + i + 2), c);
+            a = _mm_add_pd(a, _mm_mul_pd(u, u));
+            b = _mm_add_pd(b, _mm_mul_pd(v, v));
+        }
+
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(a, b));
+        sum = lanes[0] + lanes[1];
+#endif
+
+        for(; i < n; i++)
+        {
+            const double d = values[i] - center;
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    void RingBuffer::JsConstruct(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        Local<Context> context = isolate->GetCurrentContext();
+
+        if(!args.IsConstructCall())
+        {
+            ThrowTypeError(isolate, "RingBuffer must be called with new");
+            return;
+        }
+
+        const double size = args.Length() > 0 ? args[0]->NumberValue(context).FromMaybe(0.) : 0.;
+        if(!(size >= 1. && size <= kMaxCapacity) || size != floor(size))
+        {
+            isolate->ThrowException(Exception::RangeError(String::NewFromUtf8(isolate, "RingBuffer needs a size between 1 and 16777216")));
+            return;
+        }
+
+        const size_t capacity = (size_t)size;
+        Local<ArrayBuffer> value_buffer = ArrayBuffer::New(isolate, capacity * sizeof(double));
+        Local<ArrayBuffer> state_buffer = ArrayBuffer::New(isolate, sizeof(RingState));
+        ((RingState*)state_buffer->GetContents().Data())->capacity = capacity;
+
+        Local<Object> ring = args.This();
+        ring->SetInternalField(kValuesField, value_buffer);
+        ring->SetInternalField(kStateField, state_buffer);
+        ring->DefineOwnProperty(context, String::NewFromUtf8(isolate, "data"), Float64Array::New(value_buffer, 0, capacity),
+                                (PropertyAttribute)(ReadOnly | DontDelete)).FromMaybe(false);
+    }
+
+    bool RingBuffer::OpenThis(FunctionCallbackInfo<Value> const& args, RingState*& state, double*& values)
+    {
+        if(!Open(args.This(), state, values))
+        {
+            args.GetIsolate()->ThrowException(Exception::Error(String::NewFromUtf8(args.GetIsolate(), "the RingBuffer storage was transferred")));
+            return false;
+        }
+        return true;
+    }
+
+    void RingBuffer::JsPush(FunctionCallbackInfo<Value> const& args)
+    {
+        Isolate* isolate = args.GetIsolate();
+        Local<Context> context = isolate->GetCurrentContext();
+        RingState* state;
+        double* values;
+
+        // one number, or one Float64Array, goes straight into the ring.
+        if(args.Length() == 1 && (args[0]->IsNumber() || args[0]->IsFloat64Array()))
+        {
+            if(!OpenThis(args, state, values))
+            {
+                return;
+            }
+
+            if(args[0]->IsNumber())
+            {
+                const double value = Local<Number>::Cast(args[0])->Value();
+                Push(state, values, &value, 1);
+            }
+            else
+            {
+                Local<Float64Array> array = Local<Float64Array>::Cast(args[0]);
+                const char* data = (const char*)array->Buffer()->GetContents().Data();
+                Push(state, values, (const double*)(data + array->ByteOffset()), array->Length());
+            }
+
+            args.GetReturnValue().Set((double)state->count);
+            return;
+        }
+
+        // anything else is converted first, conversions may run script code.
+        vector<double> input;
+        for(int i = 0; i < args.Length(); i++)
+        {
+            if(args[i]->IsNumber())
+            {
+                input.push_back(Local<Number>::Cast(args[i])->Value());
+                continue;
+            }
+
+            if(!args[i]->IsArray() && !args[i]->IsTypedArray())
+            {
+                ThrowTypeError(isolate, "RingBuffer.push needs numbers or arrays of numbers");
+                return;
+            }
+
+            Local<Object> array = Local<Object>::Cast(args[i]);
+            const uint32_t length = args[i]->IsArray() ? Local<Array>::Cast(array)->Length() : (uint32_t)Local<TypedArray>::Cast(array)->Length();
+            for(uint32_t j = 0; j < length; j++)
+            {
+                Local<Value> element;
+                double value;
+                if(!array->Get(context, j).ToLocal(&element) || !element->NumberValue(context).To(&value))
+                {
+                    return;
+                }
+                input.push_back(value);
+            }
+        }
+
+        if(!OpenThis(args, state, values))
+        {
+            return;
+        }
+
+        Push(state, values, input.empty() ? nullptr : &input[0], input.size());
+        args.GetReturnValue().Set((double)state->count);
+    }
+
+    void RingBuffer::JsClear(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        if(OpenThis(args, state, values))
+        {
+            state->head = state->count = 0;
+        }
+    }
+
+    void RingBuffer::JsAt(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        double index = args.Length() > 0 ? args[0]->NumberValue(args.GetIsolate()->GetCurrentContext()).FromMaybe(NAN) : 0.;
+        if(!OpenThis(args, state, values))
+        {
+            return;
+        }
+
+        // 0 is the oldest value, negative indices count from the newest.
+        index = index < 0. ? ceil(index) + (double)state->count : floor(index);
+        if(index >= 0. && index < (double)state->count)
+        {
+            args.GetReturnValue().Set(values[(size_t)(state->head + (uint64_t)index) % state->capacity]);
+        }
+    }
+
+    void RingBuffer::JsSum(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        if(OpenThis(args, state, values))
+        {
+            args.GetReturnValue().Set(Sum(values, (size_t)state->count));
+        }
+    }
+
+    void RingBuffer::JsMean(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        if(OpenThis(args, state, values))
+        {
+            args.GetReturnValue().Set(state->count ? Sum(values, (size_t)state->count) / (double)state->count : NAN);
+        }
+    }
+
+    void RingBuffer::JsMin(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        double min, max;
+        if(OpenThis(args, state, values))
+        {
+            Range(values, (size_t)state->count, min, max);
+            args.GetReturnValue().Set(min);
+        }
+    }
+
+    void RingBuffer::JsMax(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        double min, max;
+        if(OpenThis(args, state, values))
+        {
+            Range(values, (size_t)state->count, min, max);
+            args.GetReturnValue().Set(max);
+        }
+    }
+
+    void RingBuffer::JsVariance(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        if(!OpenThis(args, state, values))
+        {
+            return;
+        }
+
+        // population variance, two passes for accuracy.
+        const size_t n = (size_t)state->count;
+        const double mean = n ? Sum(values, n) / (double)n : NAN;
+        args.GetReturnValue().Set(n ? SquaredDeviations(values, n, mean) / (double)n : NAN);
+    }
+
+    void RingBuffer::JsRms(FunctionCallbackInfo<Value> const& args)
+    {
+        RingState* state;
+        double* values;
+        if(OpenThis(args, state, values))
+        {
+            const size_t n = (size_t)state->count;
+            args.GetReturnValue().Set(n ? sqrt(SquaredDeviations(values, n, 0.) / (double)n) : NAN);
+        }
+    }
+
+    void RingBuffer::JsGetter(Local<String> property, const PropertyCallbackInfo<Value>& info)
+    {
+        RingState* state;
+        double* values;
+        if(!Open(info.This(), state, values))
+        {
+            info.GetReturnValue().Set(0);
+            return;
+        }
+
+        switch(Local<Integer>::Cast(info.Data())->Value())
+        {
+            case kLengthProperty:   info.GetReturnValue().Set((double)state->count); break;
+            case kCapacityProperty: info.GetReturnValue().Set((double)state->capacity); break;
+            case kHeadProperty:     info.GetReturnValue().Set((double)state->head); break;
+        }
+    }
+
+    //============================================================================
+    // WindowFeed
+    //============================================================================
+
+    WindowFeed::WindowFeed() :
+    m_write(0),
+    m_unread(0),
+    m_hop(0),
+    m_since(0),
+    m_dispatched(false)
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+
+    WindowFeed::~WindowFeed()
+    {
+        systhread_mutex_free(m_mutex);
+    }
+
+    void WindowFeed::Configure(long size, long hop)
+    {
+        systhread_mutex_lock(m_mutex);
+        m_values.assign(size > 0 ? (size_t)size : 0, 0.);
+        m_write = m_unread = 0;
+        m_hop = hop > 0 ? hop : size;
+        m_since = 0;
+        m_dispatched = false;
+        systhread_mutex_unlock(m_mutex);
+    }
+
+    bool WindowFeed::Push(double value)
+    {
+        bool dispatch = false;
+
+        systhread_mutex_lock(m_mutex);
+        const size_t size = m_values.size();
+        if(size)
+        {
+            m_values[m_write] = value;
+            m_write = m_write + 1 == size ? 0 : m_write + 1;
+            m_unread += m_unread < size;
+
+            // a window still waiting for the script is not dispatched twice.
+            if(++m_since >= m_hop && !m_dispatched)
+            {
+                m_since = 0;
+                m_dispatched = dispatch = true;
+            }
+        }
+        systhread_mutex_unlock(m_mutex);
+
+        return dispatch;
+    }
+
+    void WindowFeed::Rearm()
+    {
+        systhread_mutex_lock(m_mutex);
+        m_dispatched = false;
+        systhread_mutex_unlock(m_mutex);
+    }
+
+    size_t WindowFeed::Drain(RingState* state, double* values)
+    {
+        systhread_mutex_lock(m_mutex);
+        const size_t size = m_values.size();
+        const size_t n = m_unread;
+        if(n)
+        {
+            const size_t start = (m_write + size - n) % size;
+            const size_t first = n < size - start ? n : size - start;
+            RingBuffer::Push(state, values, &m_values[start], first);
+            RingBuffer::Push(state, values, &m_values[0], n - first);
+            m_unread = 0;
+        }
+        systhread_mutex_unlock(m_mutex);
+
+        return n;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_RING_H_
+#define _MAX_V8_RING_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+
+    //! The position of a ring buffer.
+    //! @details It lives in an ArrayBuffer the scripts can't reach, next to the one
+    //! holding the values. The head only moves once the ring is full, so the values
+    //! of a ring that is not full always start at index 0.
+    struct RingState
+    {
+        uint64_t    head;       // index of the oldest value
+        uint64_t    count;
+        uint64_t    capacity;
+    };
+
+    //! The RingBuffer type of the scripts.
+    //! @details new RingBuffer(n) keeps the last n numbers pushed into it. Its
+    //! values are exposed in storage order by the data Float64Array, head being
+    //! the index of the oldest one. Pushes are O(1) and the reductions run over
+    //! the raw storage, two values at a time where SSE2 is available.
+    class RingBuffer
+    {
+    public:
+        enum { kMaxCapacity = 1 << 24 };
+
+        //! Defines the RingBuffer constructor in a new context.
+        static void Install(Local<Context> context);
+
+        //! Returns the ring handed to msg_window, a new one if the window size has changed.
+        static MaybeLocal<Object> Window(Local<Context> context, size_t capacity);
+
+        //! Gets the state and values of a ring, returns false if its storage was transferred.
+        static bool Open(Local<Object> ring, RingState*& state, double*& values);
+
+        //! Appends values, the oldest ones are overwritten once the ring is full.
+        static void Push(RingState* state, double* values, const double* input, size_t n);
+
+        static double Sum(const double* values, size_t n);
+        static void Range(const double* values, size_t n, double& min, double& max);
+
+        //! Returns the sum of the squared differences to center.
+        static double SquaredDeviations(const double* values, size_t n, double center);
+
+    private:
+        static void JsConstruct(FunctionCallbackInfo<Value> const& args);
+        static void JsPush(FunctionCallbackInfo<Value> const& args);
+        static void JsClear(FunctionCallbackInfo<Value> const& args);
+        static void JsAt(FunctionCallbackInfo<Value> const& args);
+        static void JsSum(FunctionCallbackInfo<Value> const& args);
+        static void JsMean(FunctionCallbackInfo<Value> const& args);
+        static void JsMin(FunctionCallbackInfo<Value> const& args);
+        static void JsMax(FunctionCallbackInfo<Value> const& args);
+        static void JsVariance(FunctionCallbackInfo<Value> const& args);
+        static void JsRms(FunctionCallbackInfo<Value> const& args);
+        static void JsGetter(Local<String> property, const PropertyCallbackInfo<Value>& info);
+
+        //! Opens the receiver of a method, throws if its storage was transferred.
+        static bool OpenThis(FunctionCallbackInfo<Value> const& args, RingState*& state, double*& values);
+    };
+
+    //! Numbers received by a windowed inlet, waiting for the next msg_window call.
+    //! @details Max threads push values under a short lock, the thread running the
+    //! script moves them into the window ring. Only the last size values are kept,
+    //! older ones could not be in the window anyway.
+    class WindowFeed
+    {
+    public:
+        WindowFeed();
+        ~WindowFeed();
+
+        //! Sets the window size and the number of values between two calls, 0 turns the feed off.
+        void Configure(long size, long hop);
+
+        //! Adds a value, returns true if msg_window should be dispatched.
+        bool Push(double value);
+
+        //! Lets the next hop dispatch msg_window again, called as the previous call starts.
+        void Rearm();
+
+        //! Moves the waiting values into a ring, returns how many were moved.
+        size_t Drain(RingState* state, double* values);
+
+    private:
+        t_systhread_mutex   m_mutex;
+        vector<double>      m_values;
+        size_t              m_write;
+        size_t              m_unread;
+        long                m_hop;
+        long                m_since;
+        bool                m_dispatched;
+    };
+}
+
+#endif // _MAX_V8_RING_H_
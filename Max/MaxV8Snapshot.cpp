@@ -0,0 +1,117 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace cicm
+{
+    static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    
+    static string ExceptionMessage(TryCatch& try_catch)
+    {
+        String::Utf8Value message(try_catch.Exception());
+        return *message ? *message : "unknown error";
+    }
+    
+    bool Snapshot::Write(Isolate* isolate, Local<Context> context, Local<Value> value, string& out, string& error)
+    {
+        TryCatch try_catch(isolate);
+        ValueSerializer serializer(isolate);
+        serializer.WriteHeader();
+        
+        if(!serializer.WriteValue(context, value).FromMaybe(false))
+        {
+            error = ExceptionMessage(try_catch);
+            return false;
+        }
+        
+        // the buffer is allocated with realloc by the default delegate.
+        pair<uint8_t*, size_t> buffer = serializer.Release();
+        Encode(buffer.first, buffer.second, out);
+        free(buffer.first);
+        return true;
+    }
+    
+    void Snapshot::Encode(const uint8_t* data, size_t size, string& out)
+    {
+        out.clear();
+        out.reserve((size + 2) / 3 * 4);
+        
+        size_t i = 0;
+        for(; i + 2 < size; i += 3)
+        {
+            const uint32_t n = (data[i] << 16) | (data[i+1] << 8) | data[i+2];
+            out += base64_chars[(n >> 18) & 63];
+            out += base64_chars[(n >> 12) & 63];
+            out += base64_chars[(n >> 6) & 63];
+            out += base64_chars[n & 63];
+        }
+        
+        if(i < size)
+        {
+            const uint32_t n = (data[i] << 16) | (i + 1 < size ? data[i+1] << 8 : 0);
+            out += base64_chars[(n >> 18) & 63];
+            out += base64_chars[(n >> 12) & 63];
+            out += i + 1 < size ? base64_chars[(n >> 6) & 63] : '=';
+            out += '=';
+        }
+    }
+    
+    bool Snapshot::Decode(const char* text, vector<uint8_t>& out)
+    {
+        int8_t values[256];
+        for(int i = 0; i < 256; i++)
+        {
+            values[i] = -1;
+        }
+        for(int i = 0; i < 64; i++)
+        {
+            values[(uint8_t)base64_chars[i]] = (int8_t)i;
+        }
+        
+        out.clear();
+        out.reserve(strlen(text) / 4 * 3);
+        
+        uint32_t bits = 0;
+        int nbits = 0;
+        for(const char* p = text; *p && *p != '='; p++)
+        {
+            const int8_t v = values[(uint8_t)*p];
+            if(v < 0)
+            {
+                return false;
+            }
+            
+            bits = (bits << 6) | (uint32_t)v;
+            nbits += 6;
+            if(nbits >= 8)
+            {
+                nbits -= 8;
+                out.push_back((uint8_t)(bits >> nbits));
+            }
+        }
+        
+        return true;
+    }
+    
+    MaybeLocal<Value> Snapshot::Read(Isolate* isolate, Local<Context> context, const vector<uint8_t>& data, string& error)
+    {
+        TryCatch try_catch(isolate);
+        ValueDeserializer deserializer(isolate, data.data(), data.size());
+        
+        Local<Value> value;
+        if(!deserializer.ReadHeader(context).FromMaybe(false) || !deserializer.ReadValue(context).ToLocal(&value))
+        {
+            error = ExceptionMessage(try_catch);
+            return MaybeLocal<Value>();
+        }
+        
+        return value;
+    }
+}
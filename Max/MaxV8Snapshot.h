@@ -0,0 +1,43 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_SNAPSHOT_H_
+#define _MAX_V8_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+    
+    //! Saves and restores JavaScript values with the V8 structured clone format.
+    //! @details Snapshots are stored as base64 text so they fit in a patcher dictionary.
+    class Snapshot
+    {
+    public:
+        
+        //! Serializes value as base64 text into out.
+        //! @details Returns false and fills error if the value holds something that can't be cloned,
+        //! like a function.
+        static bool Write(Isolate* isolate, Local<Context> context, Local<Value> value, string& out, string& error);
+        
+        //! Encodes raw bytes as base64 text.
+        static void Encode(const uint8_t* data, size_t size, string& out);
+        
+        //! Decodes base64 text written by Write, returns false if the text is malformed.
+        static bool Decode(const char* text, vector<uint8_t>& out);
+        
+        //! Deserializes decoded bytes, returns an empty handle and fills error on failure.
+        static MaybeLocal<Value> Read(Isolate* isolate, Local<Context> context, const vector<uint8_t>& data, string& error);
+    };
+}
+
+#endif // _MAX_V8_SNAPSHOT_H_
@@ -0,0 +1,136 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Source.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace cicm
+{
+    //============================================================================
+    // SourceBuffer
+    //============================================================================
+
+    SourceBuffer* SourceBuffer::Read(const char* path, std::string& error)
+    {
+        const int fd = open(path, O_RDONLY);
+        struct stat info;
+        if(fd < 0 || fstat(fd, &info) != 0)
+        {
+            error = strerror(errno);
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+            return nullptr;
+        }
+
+        // sized once, a file shrinking meanwhile is read up to its new end.
+        const size_t size = (size_t)info.st_size;
+        char* data = (char*)malloc(size ? size : 1);
+        size_t done = 0;
+        while(data && done < size)
+        {
+            const ssize_t n = pread(fd, data + done, size - done, (off_t)done);
+            if(n > 0)
+            {
+                done += (size_t)n;
+            }
+            else if(n == 0)
+            {
+                break;
+            }
+            else if(errno != EINTR)
+            {
+                error = strerror(errno);
+                free(data);
+                data = nullptr;
+            }
+        }
+
+        close(fd);
+
+        if(!data)
+        {
+            if(error.empty())
+            {
+                error = "not enough memory";
+            }
+            return nullptr;
+        }
+
+        return new SourceBuffer(data, done);
+    }
+
+    SourceBuffer::SourceBuffer(char* data, size_t size) :
+    m_data(data),
+    m_size(size),
+    m_refcount(1)
+    {
+        ;
+    }
+
+    SourceBuffer::~SourceBuffer()
+    {
+        free(m_data);
+    }
+
+    void SourceBuffer::Retain()
+    {
+        ATOMIC_INCREMENT(&m_refcount);
+    }
+
+    void SourceBuffer::Release()
+    {
+        if(ATOMIC_DECREMENT(&m_refcount) == 0)
+        {
+            delete this;
+        }
+    }
+
+    bool SourceBuffer::IsAscii() const
+    {
+        const char* p = m_data;
+        const char* end = m_data + m_size;
+
+        // eight characters at a time, the high bits are or-ed together.
+        uint64_t high = 0;
+        while(p + sizeof(uint64_t) <= end)
+        {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            high |= word;
+            p += sizeof(uint64_t);
+        }
+
+        while(p < end)
+        {
+            high |= (uint8_t)*p++;
+        }
+
+        return (high & 0x8080808080808080ULL) == 0;
+    }
+
+    //============================================================================
+    // SourceStringResource
+    //============================================================================
+
+    SourceStringResource::SourceStringResource(SourceBuffer* source) : m_source(source)
+    {
+        m_source->Retain();
+    }
+
+    SourceStringResource::~SourceStringResource()
+    {
+        m_source->Release();
+    }
+}
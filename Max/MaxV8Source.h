@@ -0,0 +1,66 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_SOURCE_H_
+#define _MAX_V8_SOURCE_H_
+
+extern "C"
+{
+#include "ext_atomic.h"
+}
+
+#include <stddef.h>
+#include <string>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    //! The text of a script file read in one piece, reference counted.
+    //! @details The file is read rather than mapped: a mapping faults when the file
+    //! is truncated while it is still in use.
+    class SourceBuffer
+    {
+    public:
+
+        //! Reads a file given its absolute system path, returns nullptr and sets error on failure.
+        static SourceBuffer* Read(const char* path, std::string& error);
+
+        void Retain();
+        void Release();
+
+        const char* Data() const    {return m_data;}
+        size_t Size() const         {return m_size;}
+
+        //! Returns true if the text only holds 7-bit characters.
+        bool IsAscii() const;
+
+    private:
+        SourceBuffer(char* data, size_t size);
+        ~SourceBuffer();
+
+        char*           m_data;
+        size_t          m_size;
+        t_int32_atomic  m_refcount;
+    };
+
+    //! Exposes an ASCII source to V8 as an external string, without copy.
+    //! @details The resource keeps the buffer alive until V8 disposes the string.
+    class SourceStringResource : public v8::String::ExternalOneByteStringResource
+    {
+    public:
+        explicit SourceStringResource(SourceBuffer* source);
+        virtual ~SourceStringResource();
+
+        virtual const char* data() const    {return m_source->Data();}
+        virtual size_t length() const       {return m_source->Size();}
+
+    private:
+        SourceBuffer* m_source;
+    };
+}
+
+#endif // _MAX_V8_SOURCE_H_
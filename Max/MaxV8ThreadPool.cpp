@@ -0,0 +1,155 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8ThreadPool.h"
+
+#include <unistd.h>
+
+namespace cicm
+{
+    vector<ThreadPool::Worker*> ThreadPool::s_workers;
+    t_systhread_mutex   ThreadPool::s_sleep_mutex = nullptr;
+    t_systhread_cond    ThreadPool::s_wake = nullptr;
+    t_int32_atomic      ThreadPool::s_pending = 0;
+    t_int32_atomic      ThreadPool::s_next = 0;
+    volatile bool       ThreadPool::s_running = false;
+
+    void ThreadPool::Start()
+    {
+        if(s_running)
+        {
+            return;
+        }
+
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        const long nworkers = cores > 2 ? cores - 1 : 1;
+
+        systhread_mutex_new(&s_sleep_mutex, 0);
+        systhread_cond_new(&s_wake, 0);
+        s_running = true;
+
+        for(long i = 0; i < nworkers; i++)
+        {
+            Worker* worker = new Worker();
+            worker->index = i;
+            systhread_mutex_new(&worker->mutex, 0);
+            s_workers.push_back(worker);
+        }
+
+        // workers may steal from each other as soon as they run, so create them all first.
+        for(long i = 0; i < nworkers; i++)
+        {
+            systhread_create((method)Run, s_workers[i], 0, 0, 0, &s_workers[i]->thread);
+        }
+    }
+
+    void ThreadPool::Stop()
+    {
+        if(!s_running)
+        {
+            return;
+        }
+
+        systhread_mutex_lock(s_sleep_mutex);
+        s_running = false;
+        systhread_cond_broadcast(s_wake);
+        systhread_mutex_unlock(s_sleep_mutex);
+
+        for(vector<Worker*>::iterator it = s_workers.begin(); it != s_workers.end(); ++it)
+        {
+            unsigned int ret;
+            systhread_join((*it)->thread, &ret);
+            systhread_mutex_free((*it)->mutex);
+            delete *it;
+        }
+
+        s_workers.clear();
+        systhread_cond_free(s_wake);
+        systhread_mutex_free(s_sleep_mutex);
+    }
+
+    void ThreadPool::Post(Task task, void* arg)
+    {
+        // instances still count on their tasks to run, even at quit.
+        if(s_workers.empty())
+        {
+            task(arg);
+            return;
+        }
+        
+        Job job = {task, arg};
+        Worker* worker = s_workers[(unsigned)ATOMIC_INCREMENT(&s_next) % s_workers.size()];
+
+        systhread_mutex_lock(worker->mutex);
+        worker->jobs.push_back(job);
+        systhread_mutex_unlock(worker->mutex);
+
+        // the pending count is checked under the sleep mutex, so a worker about to sleep can't miss this job.
+        systhread_mutex_lock(s_sleep_mutex);
+        ATOMIC_INCREMENT(&s_pending);
+        systhread_cond_signal(s_wake);
+        systhread_mutex_unlock(s_sleep_mutex);
+    }
+
+    bool ThreadPool::Take(Worker* worker, Job& job)
+    {
+        // newest own job first, it is the most likely to be cache-warm.
+        systhread_mutex_lock(worker->mutex);
+        if(!worker->jobs.empty())
+        {
+            job = worker->jobs.back();
+            worker->jobs.pop_back();
+            systhread_mutex_unlock(worker->mutex);
+            return true;
+        }
+        systhread_mutex_unlock(worker->mutex);
+
+        // then steal the oldest job of another worker.
+        const size_t nworkers = s_workers.size();
+        for(size_t i = 1; i < nworkers; i++)
+        {
+            Worker* victim = s_workers[(worker->index + i) % nworkers];
+            systhread_mutex_lock(victim->mutex);
+            if(!victim->jobs.empty())
+            {
+                job = victim->jobs.front();
+                victim->jobs.pop_front();
+                systhread_mutex_unlock(victim->mutex);
+                return true;
+            }
+            systhread_mutex_unlock(victim->mutex);
+        }
+
+        return false;
+    }
+
+    void* ThreadPool::Run(Worker* worker)
+    {
+        // a stopping pool still runs the pending tasks, instances wait for them to be freed.
+        bool running = true;
+        while(running)
+        {
+            Job job;
+            if(Take(worker, job))
+            {
+                ATOMIC_DECREMENT(&s_pending);
+                job.task(job.arg);
+                continue;
+            }
+
+            systhread_mutex_lock(s_sleep_mutex);
+            while(s_running && s_pending <= 0)
+            {
+                systhread_cond_wait(s_wake, s_sleep_mutex);
+            }
+            running = s_running || s_pending > 0;
+            systhread_mutex_unlock(s_sleep_mutex);
+        }
+
+        systhread_exit(0);
+        return nullptr;
+    }
+}
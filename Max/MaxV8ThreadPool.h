@@ -0,0 +1,74 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_THREAD_POOL_H_
+#define _MAX_V8_THREAD_POOL_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+#include "ext_atomic.h"
+}
+
+#include <deque>
+#include <vector>
+
+namespace cicm
+{
+    using namespace std;
+
+    //! A process-wide pool of worker threads.
+    //! @details Every worker owns a task deque, it pops its own tasks from the back
+    //! and steals from the front of the other deques when it runs out of work.
+    class ThreadPool
+    {
+    public:
+
+        typedef void (*Task)(void* arg);
+
+        //! Starts one worker per core, leaving one core to the main thread.
+        static void Start();
+
+        //! Stops and joins the workers once they have run every pending task.
+        //! @details Tasks posted after the pool has stopped run on the calling thread.
+        static void Stop();
+
+        //! Schedules a task on one of the workers.
+        static void Post(Task task, void* arg);
+
+        //! Returns the number of workers.
+        static long Size() {return (long)s_workers.size();}
+
+    private:
+
+        struct Job
+        {
+            Task    task;
+            void*   arg;
+        };
+
+        struct Worker
+        {
+            t_systhread         thread;
+            t_systhread_mutex   mutex;
+            deque<Job>          jobs;
+            long                index;
+        };
+
+        static void* Run(Worker* worker);
+        static bool Take(Worker* worker, Job& job);
+
+        static vector<Worker*>      s_workers;
+        static t_systhread_mutex    s_sleep_mutex;
+        static t_systhread_cond     s_wake;
+        static t_int32_atomic       s_pending;
+        static t_int32_atomic       s_next;
+        static volatile bool        s_running;
+    };
+}
+
+#endif // _MAX_V8_THREAD_POOL_H_
@@ -0,0 +1,199 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Wasm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utility>
+
+namespace cicm
+{
+    //! Header of a cache file, followed by the serialized module.
+    struct WasmCacheHeader
+    {
+        char        magic[8];
+        uint64_t    wire_hash;
+        uint64_t    wire_size;
+    };
+    
+    static const char wasm_cache_magic[8] = {'v', '8', 'j', 's', 'w', 'a', 's', 'm'};
+    
+    static uint64_t Hash(const uint8_t* data, size_t size)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+    
+    map<string, WasmCache::Entry>   WasmCache::s_entries;
+    t_systhread_mutex               WasmCache::s_mutex = nullptr;
+    
+    void WasmCache::Init()
+    {
+        systhread_mutex_new(&s_mutex, 0);
+    }
+    
+    void WasmCache::Release()
+    {
+        for(map<string, Entry>::iterator it = s_entries.begin(); it != s_entries.end(); ++it)
+        {
+            delete it->second.module;
+        }
+        s_entries.clear();
+        systhread_mutex_free(s_mutex);
+    }
+    
+    MaybeLocal<WasmCompiledModule> WasmCache::Load(Isolate* isolate, const char* path, string& error)
+    {
+        struct stat info;
+        if(stat(path, &info) != 0)
+        {
+            error = string("can't open ") + path;
+            return MaybeLocal<WasmCompiledModule>();
+        }
+        
+        // compiled by this process already, unless the file changed since.
+        systhread_mutex_lock(s_mutex);
+        map<string, Entry>::iterator it = s_entries.find(path);
+        if(it != s_entries.end() && it->second.size == (int64_t)info.st_size && it->second.mtime == (int64_t)info.st_mtime)
+        {
+            MaybeLocal<WasmCompiledModule> module = WasmCompiledModule::FromTransferrableModule(isolate, *it->second.module);
+            systhread_mutex_unlock(s_mutex);
+            return module;
+        }
+        systhread_mutex_unlock(s_mutex);
+        
+        vector<uint8_t> wire;
+        if(!ReadFile(path, wire))
+        {
+            error = string("can't read ") + path;
+            return MaybeLocal<WasmCompiledModule>();
+        }
+        const uint64_t hash = Hash(wire.data(), wire.size());
+        
+        // compiled code of a previous launch, V8 compiles the wire bytes if it doesn't match its version.
+        vector<uint8_t> cached;
+        const string cache_path = CachePath(path);
+        const WasmCacheHeader* header = nullptr;
+        if(ReadFile(cache_path.c_str(), cached) && cached.size() > sizeof(WasmCacheHeader))
+        {
+            header = (const WasmCacheHeader*)cached.data();
+            if(memcmp(header->magic, wasm_cache_magic, sizeof(wasm_cache_magic)) != 0
+               || header->wire_hash != hash || header->wire_size != wire.size())
+            {
+                header = nullptr;
+            }
+        }
+        
+        const WasmCompiledModule::CallerOwnedBuffer wire_bytes(wire.data(), wire.size());
+        const WasmCompiledModule::CallerOwnedBuffer compiled_code = header ?
+        WasmCompiledModule::CallerOwnedBuffer(cached.data() + sizeof(WasmCacheHeader), cached.size() - sizeof(WasmCacheHeader)) :
+        WasmCompiledModule::CallerOwnedBuffer(nullptr, 0);
+        
+        Local<WasmCompiledModule> module;
+        if(!WasmCompiledModule::DeserializeOrCompile(isolate, compiled_code, wire_bytes).ToLocal(&module))
+        {
+            return MaybeLocal<WasmCompiledModule>();
+        }
+        
+        if(!header)
+        {
+            WriteCache(cache_path.c_str(), hash, wire, module->Serialize());
+        }
+        
+        Entry entry = {(int64_t)info.st_size, (int64_t)info.st_mtime,
+                       new WasmCompiledModule::TransferrableModule(module->GetTransferrableModule())};
+        
+        systhread_mutex_lock(s_mutex);
+        it = s_entries.find(path);
+        if(it != s_entries.end())
+        {
+            delete it->second.module;
+            it->second = entry;
+        }
+        else
+        {
+            s_entries[path] = entry;
+        }
+        systhread_mutex_unlock(s_mutex);
+        
+        return module;
+    }
+    
+    string WasmCache::CachePath(const char* path)
+    {
+        const char* home = getenv("HOME");
+        string folder = home ? home : "/tmp";
+#ifdef __APPLE__
+        folder += "/Library/Caches/v8js";
+#else
+        folder += "/.cache";
+        mkdir(folder.c_str(), 0755);
+        folder += "/v8js";
+#endif
+        mkdir(folder.c_str(), 0755);
+        
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.wasmcache", (unsigned long long)Hash((const uint8_t*)path, strlen(path)));
+        return folder + name;
+    }
+    
+    bool WasmCache::ReadFile(const char* path, vector<uint8_t>& bytes)
+    {
+        FILE* file = fopen(path, "rb");
+        if(!file)
+        {
+            return false;
+        }
+        
+        fseek(file, 0, SEEK_END);
+        const long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        
+        bytes.resize(size > 0 ? (size_t)size : 0);
+        const bool read = size > 0 && fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        fclose(file);
+        return read;
+    }
+    
+    void WasmCache::WriteCache(const char* path, uint64_t hash, vector<uint8_t> const& wire, WasmCompiledModule::SerializedModule const& code)
+    {
+        // nothing to save while V8 is still tiering the module up.
+        if(!code.first || !code.second)
+        {
+            return;
+        }
+        
+        // written aside and renamed, so another process never reads half a file.
+        const string temp = string(path) + ".tmp";
+        FILE* file = fopen(temp.c_str(), "wb");
+        if(!file)
+        {
+            return;
+        }
+        
+        WasmCacheHeader header;
+        memcpy(header.magic, wasm_cache_magic, sizeof(wasm_cache_magic));
+        header.wire_hash = hash;
+        header.wire_size = wire.size();
+        
+        const bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(code.first.get(), 1, code.second, file) == code.second;
+        fclose(file);
+        
+        if(!written || rename(temp.c_str(), path) != 0)
+        {
+            remove(temp.c_str());
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_WASM_H_
+#define _MAX_V8_WASM_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+}
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    using namespace v8;
+    using namespace std;
+    
+    //! A process-wide cache of compiled WebAssembly modules.
+    //! @details A .wasm file is compiled once per process, other isolates get the
+    //! compiled code through a transferrable module. The compiled code is also saved
+    //! in the user cache folder so the next launch can skip the compilation.
+    class WasmCache
+    {
+    public:
+        
+        static void Init();
+        static void Release();
+        
+        //! Returns the compiled module of a .wasm file given its absolute system path.
+        //! @details On failure the handle is empty and either error is set or an exception is pending.
+        static MaybeLocal<WasmCompiledModule> Load(Isolate* isolate, const char* path, string& error);
+        
+    private:
+        
+        struct Entry
+        {
+            int64_t                                 size;
+            int64_t                                 mtime;
+            WasmCompiledModule::TransferrableModule* module;
+        };
+        
+        //! Returns the path of the compiled code of a .wasm file in the cache folder.
+        static string CachePath(const char* path);
+        
+        static bool ReadFile(const char* path, vector<uint8_t>& bytes);
+        static void WriteCache(const char* path, uint64_t hash, vector<uint8_t> const& wire, WasmCompiledModule::SerializedModule const& code);
+        
+        static map<string, Entry>   s_entries;
+        static t_systhread_mutex    s_mutex;
+    };
+}
+
+#endif // _MAX_V8_WASM_H_
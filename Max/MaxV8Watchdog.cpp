@@ -0,0 +1,151 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#include "MaxV8Watchdog.h"
+
+#include <algorithm>
+
+namespace cicm
+{
+    //! Resolution of the watchdog in milliseconds.
+    static const long kPollInterval = 5;
+
+    t_systhread         Watchdog::s_thread = nullptr;
+    t_systhread_mutex   Watchdog::s_mutex = nullptr;
+    std::vector<Watchdog::Entry*> Watchdog::s_entries;
+    volatile bool       Watchdog::s_running = false;
+
+    //============================================================================
+    // Watchdog::Entry
+    //============================================================================
+
+    Watchdog::Entry::Entry() :
+    m_mutex(nullptr),
+    m_isolate(nullptr),
+    m_handler(nullptr),
+    m_deadline(0.),
+    m_depth(0),
+    m_expired(false)
+    {
+        systhread_mutex_new(&m_mutex, 0);
+    }
+
+    Watchdog::Entry::~Entry()
+    {
+        systhread_mutex_free(m_mutex);
+    }
+
+    void Watchdog::Entry::Arm(v8::Isolate* isolate, t_symbol* handler, long budget_ms)
+    {
+        // only the outermost call is timed, nested calls run inside its budget.
+        if(m_depth++ > 0 || budget_ms <= 0)
+        {
+            return;
+        }
+
+        systhread_mutex_lock(m_mutex);
+        m_isolate = isolate;
+        m_handler = handler;
+        m_expired = false;
+        m_deadline = systimer_gettime() + budget_ms;
+        systhread_mutex_unlock(m_mutex);
+    }
+
+    bool Watchdog::Entry::Disarm()
+    {
+        if(m_depth == 0 || --m_depth > 0)
+        {
+            return false;
+        }
+
+        systhread_mutex_lock(m_mutex);
+        const bool expired = m_expired;
+        m_deadline = 0.;
+        m_expired = false;
+        systhread_mutex_unlock(m_mutex);
+
+        if(expired)
+        {
+            // the termination exception has unwound the whole stack, let the isolate run again.
+            m_isolate->CancelTerminateExecution();
+        }
+
+        return expired;
+    }
+
+    //============================================================================
+    // Watchdog
+    //============================================================================
+
+    void Watchdog::Start()
+    {
+        if(s_running)
+        {
+            return;
+        }
+
+        systhread_mutex_new(&s_mutex, 0);
+        s_running = true;
+        systhread_create((method)Run, nullptr, 0, 0, 0, &s_thread);
+    }
+
+    void Watchdog::Stop()
+    {
+        if(!s_running)
+        {
+            return;
+        }
+
+        unsigned int ret;
+        s_running = false;
+        systhread_join(s_thread, &ret);
+        s_thread = nullptr;
+
+        systhread_mutex_free(s_mutex);
+        s_mutex = nullptr;
+    }
+
+    void Watchdog::Register(Entry* entry)
+    {
+        systhread_mutex_lock(s_mutex);
+        s_entries.push_back(entry);
+        systhread_mutex_unlock(s_mutex);
+    }
+
+    void Watchdog::Unregister(Entry* entry)
+    {
+        systhread_mutex_lock(s_mutex);
+        s_entries.erase(std::remove(s_entries.begin(), s_entries.end(), entry), s_entries.end());
+        systhread_mutex_unlock(s_mutex);
+    }
+
+    void* Watchdog::Run(void* arg)
+    {
+        while(s_running)
+        {
+            systhread_sleep(kPollInterval);
+
+            const double now = systimer_gettime();
+
+            systhread_mutex_lock(s_mutex);
+            for(std::vector<Entry*>::iterator it = s_entries.begin(); it != s_entries.end(); ++it)
+            {
+                Entry* entry = *it;
+                systhread_mutex_lock(entry->m_mutex);
+                if(entry->m_deadline > 0. && !entry->m_expired && now >= entry->m_deadline)
+                {
+                    entry->m_expired = true;
+                    entry->m_isolate->TerminateExecution();
+                }
+                systhread_mutex_unlock(entry->m_mutex);
+            }
+            systhread_mutex_unlock(s_mutex);
+        }
+
+        systhread_exit(0);
+        return nullptr;
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ // Copyright (c) 2015 Eliott Paris, CICM, Universite Paris 8.
+ // For information on usage and redistribution, and for a DISCLAIMER OF ALL
+ // WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+ */
+
+#ifndef _MAX_V8_WATCHDOG_H_
+#define _MAX_V8_WATCHDOG_H_
+
+extern "C"
+{
+#include "ext.h"
+#include "ext_systhread.h"
+#include "ext_systime.h"
+}
+
+#include <vector>
+
+#include "include/v8.h"
+
+namespace cicm
+{
+    //! A background thread that terminates JavaScript running past its time budget.
+    //! @details Each v8js instance owns one Entry. The entry is armed when the
+    //! instance enters JavaScript and disarmed when it returns. If the budget runs
+    //! out in between, the watchdog calls Isolate::TerminateExecution and flags the
+    //! entry, the owner then cancels the termination and reports the overrun.
+    class Watchdog
+    {
+    public:
+
+        class Entry
+        {
+        public:
+            Entry();
+            ~Entry();
+
+            //! Starts the time budget for a call, nested calls share the outermost budget.
+            void Arm(v8::Isolate* isolate, t_symbol* handler, long budget_ms);
+
+            //! Stops the time budget, returns true if the call has been terminated.
+            bool Disarm();
+
+            //! The handler that was running when the entry last expired.
+            t_symbol* Handler() const {return m_handler;}
+
+        private:
+            friend class Watchdog;
+
+            t_systhread_mutex   m_mutex;
+            v8::Isolate*        m_isolate;
+            t_symbol*           m_handler;
+            double              m_deadline;
+            long                m_depth;
+            bool                m_expired;
+        };
+
+        //! Starts the watchdog thread.
+        static void Start();
+
+        //! Stops and joins the watchdog thread.
+        static void Stop();
+
+        //! Adds an entry to the set of entries the watchdog looks after.
+        static void Register(Entry* entry);
+
+        //! Removes an entry, the entry must be disarmed.
+        static void Unregister(Entry* entry);
+
+    private:
+
+        static void* Run(void* arg);
+
+        static t_systhread          s_thread;
+        static t_systhread_mutex    s_mutex;
+        static std::vector<Entry*>  s_entries;
+        static volatile bool        s_running;
+    };
+}
+
+#endif // _MAX_V8_WATCHDOG_H_
@@ -7,7 +7,27 @@ var stringToEval = "";
 function bang()
 {
 	post("eval : " + stringToEval);
-	outlet(0, eval(stringToEval));
+	outlet(0, evaluate(stringToEval));
+}
+
+// compile() caches the function, the same expression is only compiled once.
+// Statements aren't an expression and go through eval, which returns the value
+// of the last one. Both only see the global scope. The text has to parse on its
+// own first, otherwise "a); b = (c" would close the parenthesis and pass for an
+// expression; eval reports the syntax error of a text that doesn't.
+function evaluate(text)
+{
+	var expression;
+	try
+	{
+		new Function(text);
+		expression = compile("(" + text + "\n)");
+	}
+	catch(e)
+	{
+		return (0, eval)(text);
+	}
+	return expression();
 }
 
 function set(v)
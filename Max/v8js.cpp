@@ -22,11 +22,22 @@ void ext_main(void *r)
     class_addmethod(c, (method)MaxV8::Int,              "int",          A_LONG,     0);
     class_addmethod(c, (method)MaxV8::Float,            "float",        A_FLOAT,    0);
     class_addmethod(c, (method)MaxV8::Anything,         "anything",     A_GIMME,    0);
+    class_addmethod(c, (method)MaxV8::SaveState,        "appendtodictionary", A_CANT, 0);
+    
+    // diagnostics are prefixed, a script may handle messages of the same name.
+    class_addmethod(c, (method)MaxV8::Latency,          "v8js.latency", A_GIMME,    0);
+    class_addmethod(c, (method)MaxV8::Trace,            "v8js.trace",   A_GIMME,    0);
+    class_addmethod(c, (method)MaxV8::JitReport,        "v8js.jitreport", A_GIMME,  0);
+    class_addmethod(c, (method)MaxV8::Top,              "v8js.top",     A_GIMME,    0);
+    class_addmethod(c, (method)MaxV8::Memory,           "v8js.memory",  0,          0);
+    
     class_addmethod(c, (method)MaxV8::OpenEditor,       "dblclick",     A_CANT,     0);
     class_addmethod(c, (method)MaxV8::OpenEditor,       "open",         0,          0);
     class_addmethod(c, (method)MaxV8::EditorClosed,     "edclose",      A_CANT,     0);
     class_addmethod(c, (method)MaxV8::EditorSaved,      "edsave",       A_CANT,     0);
     
+    MaxV8::RegisterAttributes(c);
+    
     // global v8 init
     MaxV8::Init();
     
@@ -1,20 +1,21 @@
 #!/usr/bin/env sh
 
+# v8js is written against the V8 6.8 API (the version of Node 10): later
+# versions drop WasmCompiledModule and ArrayBuffer::Neuter, earlier ones lack
+# CompileFunctionInContext options and the one argument CreateCodeCacheForFunction.
+V8_VERSION=6.8.275.32
+
 git clone https://chromium.googlesource.com/chromium/tools/depot_tools.git
 export PATH=`pwd`/depot_tools:"$PATH"
 fetch --no-history v8
 cd v8
-gclient sync
-export CXXFLAGS="-Wno-unknown-warning-option"
-export CXX=`which clang++`
-export CC=`which clang`
-export CPP="`which clang` -E -std=c++11 -stdlib=libc++"
-export LINK="`which clang++` -std=c++11 -stdlib=libc++"
-export CXX_host=`which clang++`
-export CC_host=`which clang`
-export CPP_host="`which clang` -E"
-export LINK_host=`which clang++`
-export GYP_DEFINES="clang=1 mac_deployment_target=10.7"
-make native -j8
-# make native -j8 snapshot=off
+git fetch --depth=1 origin refs/tags/$V8_VERSION
+git checkout FETCH_HEAD
+gclient sync -D
 
+# V8 builds with GN since 6.x: one static library holding V8, its platform and
+# ICU with its data, linked by the Xcode project from out/native.
+gn gen out.gn/x64.release --args='is_debug=false target_cpu="x64" is_component_build=false v8_monolithic=true v8_use_external_startup_data=false icu_use_data_file=false use_custom_libcxx=false mac_deployment_target="10.9"'
+ninja -C out.gn/x64.release v8_monolith
+mkdir -p out/native
+cp out.gn/x64.release/obj/libv8_monolith.a out/native/